@@ -11,7 +11,7 @@
  * 因此这里的启动代码将被页目录覆盖掉.
  */
 .text
-.globl _idt,_gdt,_pg_dir,_tmp_floppy_area
+.globl _idt,_gdt,_pg_dir,_tmp_floppy_area,_x86,_cpu_features
 _pg_dir:
 startup_32:
     movl $0x10,%eax
@@ -106,8 +106,9 @@ setup_gdt:
 
 /*
  * I put the kernel page tables right after the page directory,
- * using 4 of them to span 16 Mb of physical memory. People with
- * more than 16MB will have to expand this.
+ * using 4 of them to span 16 Mb of physical memory. Memory above
+ * 16Mb (up to 64Mb) gets its page tables from paging_init() in
+ * mm/memory.c, once main() knows how much memory there is.
  */
 .org 0x1000
 pg0:
@@ -168,6 +169,45 @@ ignore_int:
     iret                    /* 中断返回. */
 
 
+/*
+ * 检测CPU类型，结果存入_x86：386上EFLAGS的AC位(18)不能改变，_x86=3；否则至少是
+ * 486，_x86=4。再检测能否改变ID位(21)，能则有cpuid指令，把功能号1返回的族号存入
+ * _x86，特性标志(edx)存入_cpu_features；否则_cpu_features保持为0.
+ */
+.align 2
+check_x86:
+    movl $3,_x86
+    pushfl
+    popl %ecx               /* ecx保存原来的EFLAGS. */
+    movl %ecx,%eax
+    xorl $0x40000,%eax      /* 试着翻转AC位. */
+    pushl %eax
+    popfl
+    pushfl
+    popl %eax
+    xorl %ecx,%eax
+    testl $0x40000,%eax
+    je 1f                   /* AC位不能改变：386. */
+    movl $4,_x86
+    movl %ecx,%eax
+    xorl $0x200000,%eax     /* 试着翻转ID位. */
+    pushl %eax
+    popfl
+    pushfl
+    popl %eax
+    xorl %ecx,%eax
+    testl $0x200000,%eax
+    je 1f                   /* ID位不能改变：没有cpuid指令. */
+    movl $1,%eax
+    .byte 0x0f,0xa2         /* cpuid */
+    movl %edx,_cpu_features
+    shrl $8,%eax
+    andl $0xf,%eax          /* 族号. */
+    movl %eax,_x86
+1:  pushl %ecx              /* 恢复原来的EFLAGS. */
+    popfl
+    ret
+
 /*
  * Setup_paging
  *
@@ -198,7 +238,32 @@ setup_paging:               /* 首先对5页内存(1页目录 + 4页页表)清
     xorl %eax,%eax
     xorl %edi,%edi          /* pg_dir is at 0x000 */
     cld;rep;stosl
-    movl $pg0+7,_pg_dir     /* set present bit/user r/w */
+/*
+ * CPU支持4MB页(PSE)时，内核的16MB恒等映射直接用4个4MB页目录项，不要页表，
+ * 整个内核区只占几个TLB项。若还支持全局页(PGE)，则同时置G位，这些TLB项在重新
+ * 加载cr3时不会被刷新(所有任务共用这一个页目录，内核映射是永远不变的).
+ */
+    call check_x86
+    testl $0x8,_cpu_features    /* PSE */
+    je 2f
+    movl $0x87,%eax         /* 4MB page, r/w user, p */
+    movl $0x10,%edx         /* cr4.PSE */
+    testl $0x2000,_cpu_features /* PGE */
+    je 1f
+    orl $0x100,%eax         /* global */
+    orl $0x80,%edx          /* cr4.PGE */
+1:  movl %eax,_pg_dir
+    addl $0x400000,%eax
+    movl %eax,_pg_dir+4
+    addl $0x400000,%eax
+    movl %eax,_pg_dir+8
+    addl $0x400000,%eax
+    movl %eax,_pg_dir+12
+    .byte 0x0f,0x20,0xe0    /* movl %cr4,%eax */
+    orl %edx,%eax
+    .byte 0x0f,0x22,0xe0    /* movl %eax,%cr4 */
+    jmp 3f
+2:  movl $pg0+7,_pg_dir     /* set present bit/user r/w */
     movl $pg1+7,_pg_dir+4   /*  --------- " " --------- */
     movl $pg2+7,_pg_dir+8   /*  --------- " " --------- */
     movl $pg3+7,_pg_dir+12  /*  --------- " " --------- */
@@ -208,13 +273,18 @@ setup_paging:               /* 首先对5页内存(1页目录 + 4页页表)清
 1:  stosl                   /* fill pages backwards - more efficient :-) */
     subl $0x1000,%eax
     jge 1b
-    xorl %eax,%eax          /* pg_dir is at 0x0000 */
+3:  xorl %eax,%eax          /* pg_dir is at 0x0000 */
     movl %eax,%cr3          /* cr3 - page directory start */
     movl %cr0,%eax
     orl $0x80000000,%eax    /* 添上PG标志. */
     movl %eax,%cr0          /* set paging (PG) bit */
     ret                     /* this also flushes prefetch-queue */
 
+.align 2
+_x86:                       /* CPU族号：3，4，5...，见check_x86. */
+    .long 0
+_cpu_features:              /* cpuid功能号1返回的edx，见check_x86. */
+    .long 0
 .align 2                    /* 按4字节方式对齐内存地址边界. */
 .word 0
 idt_descr:                  /* 下面两行是lidt指令的6字节操作数：长度，基址. */
@@ -230,7 +300,7 @@ gdt_descr:                  /* 下面两行是lgdt指令的6字节操作数：
 _idt:   .fill 256,8,0       /* idt is uninitialized. */
 
 _gdt:   .quad 0x0000000000000000/* NULL descriptor */
-    .quad 0x00c09a0000000fff    /* 代码段最大长度16Mb */
-    .quad 0x00c0920000000fff    /* 数据段最大长度16Mb */
+    .quad 0x00c09a0000003fff    /* 代码段最大长度64Mb */
+    .quad 0x00c0920000003fff    /* 数据段最大长度64Mb */
     .quad 0x0000000000000000    /* TEMPORARY - don't use */
     .fill 252,8,0               /* space for LDT's and TSS's etc */
@@ -15,6 +15,10 @@ INITSEG  = 0x9000   ! 原来bootsect所处的段.
 SYSSEG   = 0x1000   ! system在0x10000(64k)处.
 SETUPSEG = 0x9020   ! 本程序所在的段地址.
 
+E820NR   = 0x00A0   ! E820内存映射表项数存放在0x900A0.
+E820MAP  = 0x00A4   ! E820内存映射表存放在0x900A4.
+E820MAX  = 16       ! 最多16项,到0x901E4为止(0x901FC处是根设备号).
+
 .globl begtext, begdata, begbss, endtext, enddata, endbss
 .text
 begtext:
@@ -42,6 +46,40 @@ start:
     int 0x15
     mov [2],ax
 
+! Get memory map (INT 0x15, AX=0xE820)
+! AH=0x88最多只能报告64Mb,也不知道内存中的空洞.这里取BIOS的E820内存映射表,
+! 每项20字节(基址8字节,长度8字节,类型4字节),最多E820MAX项,存放在0x900A4开始处,
+! 项数存放在0x900A0.BIOS不支持该功能时项数为0,此时内核仍使用上面的扩展内存大小.
+! 以下用到的32位寄存器指令由于as86 -0不支持,直接用操作数大小前缀(0x66)编码.
+
+    xor ax,ax
+    mov [E820NR],ax
+    mov ax,#INITSEG
+    mov es,ax
+    mov di,#E820MAP     ! es:di指向存放表项的位置.
+    .byte   0x66,0x31,0xdb  ! xor ebx,ebx - 续传值,第一次调用为0.
+e820_loop:
+    .byte   0x66,0xb8       ! mov eax,#0xe820
+    .word   0xe820,0x0000
+    .byte   0x66,0xba       ! mov edx,#0x534d4150 ('SMAP')
+    .word   0x4150,0x534d
+    .byte   0x66,0xb9       ! mov ecx,#20 - 每项的字节数.
+    .word   20,0
+    int 0x15
+    jc  e820_done       ! CF=1表示出错或已经取完.
+    .byte   0x66,0x3d       ! cmp eax,#0x534d4150
+    .word   0x4150,0x534d
+    jne e820_done       ! 返回值不是'SMAP',说明BIOS不支持E820.
+    add di,#20
+    mov ax,[E820NR]
+    inc ax
+    mov [E820NR],ax
+    cmp ax,#E820MAX
+    jae e820_done       ! 表已满.
+    .byte   0x66,0x85,0xdb  ! test ebx,ebx - 为0表示这是最后一项.
+    jne e820_loop
+e820_done:
+
 ! Get video-card data:
 
     mov ah,#0x0f
@@ -29,7 +29,7 @@ extern int end;
 struct buffer_head *start_buffer = (struct buffer_head *)&end;
 struct buffer_head *hash_table[NR_HASH];    /* NR_HASH = 307 项. */
 static struct buffer_head *free_list;
-static struct task_struct *buffer_wait = NULL;
+static struct wait_queue *buffer_wait = NULL;
 int NR_BUFFERS = 0;
 
 /**
@@ -291,11 +291,20 @@ struct buffer_head *get_hash_table(int dev, int block)
 struct buffer_head *getblk(int dev, int block)
 {
     struct buffer_head *tmp, *bh;
+    int woken = 0;
 
 repeat:
-    /* 搜索hash表，如果指定块已经在高速缓冲中，则返回对应缓冲区头指针，退出. */
+    /**
+     * 搜索hash表，如果指定块已经在高速缓冲中，则返回对应缓冲区头指针，退出。
+     * 如果是等空闲缓冲区时被唤醒的，空出的缓冲区没有用上，则把唤醒传给下一个等待者.
+     */
     if (bh = get_hash_table(dev, block))
+    {
+        if (woken)
+            wake_up(&buffer_wait);
+
         return bh;
+    }
 
     /**
      * 扫描空闲数据块链表，寻找空闲缓冲区。
@@ -327,7 +336,8 @@ repeat:
     /* 如果所有缓冲区都正被使用(所有缓冲区的头部引用计数都>0)，则睡眠，等待有空闲的缓冲区可用. */
     if (!bh)
     {
-        sleep_on(&buffer_wait);
+        sleep_on_exclusive(&buffer_wait);
+        woken = 1;
         goto repeat;
     }
 
@@ -445,11 +455,11 @@ struct buffer_head *bread(int dev, int block)
  * bread_page一次读四个缓冲块内容读到内存指定的地址。它是一个完整的函数，
  * 因为同时读取四块可以获得速度上的好处，不用等着读一块，再读一块了.
  */
-/* 读设备上一个页面(4个缓冲块)的内容到内存指定的地址. */
-void bread_page(unsigned long address, int dev, int b[4])
+/* 读设备上一个页面(4个缓冲块)的内容到内存指定的地址。有块读不出来时返回0，否则返回1. */
+int bread_page(unsigned long address, int dev, int b[4])
 {
     struct buffer_head *bh[4];
-    int i;
+    int i, ok = 1;
 
     /* 循环执行4次，读一页内容. */
     for (i = 0; i < 4; i++)
@@ -473,10 +483,16 @@ void bread_page(unsigned long address, int dev, int b[4])
             /* 如果该缓冲区中数据有效的话，则复制. */
             if (bh[i]->b_uptodate)
                 COPYBLK((unsigned long)bh[i]->b_data, address);
+            else
+                ok = 0;
 
             /* 释放该缓冲区. */
             brelse(bh[i]);
         }
+        else if (b[i])
+            ok = 0;
+
+    return ok;
 }
 
 /*
@@ -235,6 +235,7 @@ static unsigned long change_ldt(unsigned long text_size, unsigned long *page)
     set_limit(current->ldt[1], code_limit);
     set_base(current->ldt[2], data_base);
     set_limit(current->ldt[2], data_limit);
+    load_ldt();
 
     /* 要确信fs段寄存器已指向新的数据段. */
     /* fs段寄存器中放入局部表数据段描述符的选择符(0x17). */
@@ -242,7 +243,7 @@ static unsigned long change_ldt(unsigned long text_size, unsigned long *page)
 
     /**
      * 将参数和环境空间已存放数据的页面(共可有MAX_ARG_PAGES页，128kB)放到
-     * 数据段线性地址的末端。是调用函数put_page()进行操作的(mm/memory.c).
+     * 数据段线性地址的末端。是调用函数put_dirty_page()进行操作的(mm/memory.c).
      */
     data_base += data_limit;
 
@@ -253,7 +254,7 @@ static unsigned long change_ldt(unsigned long text_size, unsigned long *page)
         /* 如果该页面存在. */
         if (page[i])
             /* 就放置该页面. */
-            put_page(page[i], data_base);
+            put_dirty_page(page[i], data_base);
     }
 
     /* 最后返回数据段限长(64MB). */
@@ -472,8 +473,28 @@ restart_interp:
             sys_close(i);
 
     current->close_on_exec = 0;
-    free_page_tables(get_base(current->ldt[1]), get_limit(0x0f));
-    free_page_tables(get_base(current->ldt[2]), get_limit(0x17));
+    exit_mmap(current);
+
+    /**
+     * vfork()的子进程用的是父进程的地址空间，不能释放。把段基址改为自己的64MB线性空间
+     * (任务号*64MB，与copy_mem()相同)，由下面的change_ldt()重新设置，然后唤醒父进程.
+     */
+    if (current->vfork_parent)
+    {
+        for (i = 1; i < NR_TASKS; i++)
+            if (task[i] == current)
+                break;
+
+        set_base(current->ldt[1], i * 0x4000000);
+        set_base(current->ldt[2], i * 0x4000000);
+        current->start_code = i * 0x4000000;
+        vfork_release(current);
+    }
+    else
+    {
+        free_page_tables(get_base(current->ldt[1]), get_limit(0x0f));
+        free_page_tables(get_base(current->ldt[2]), get_limit(0x17));
+    }
 
     if (last_task_used_math == current)
         last_task_used_math = NULL;
@@ -117,6 +117,10 @@ int file_write(struct m_inode *inode, struct file *filp, char *buf, int count)
     else
         pos = filp->f_pos;
 
+    /* 执行文件页面缓存中被覆盖的页面作废. */
+    if (count > 0)
+        invalidate_cache_pages(inode, pos, count);
+
     /* 若已写入字节数i小于需要写入的字节数count，则循环执行以下操作. */
     while (i < count)
     {
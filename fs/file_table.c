@@ -4,7 +4,54 @@
  *  (C) 1991  Linus Torvalds
  */
 
+#include <string.h>
+
 #include <linux/fs.h>
+#include <linux/kernel.h>
+
+/**
+ * 文件结构从对象缓存中分配(lib/malloc.c)，不再是固定的64项数组。能同时打开的
+ * 文件数只受内存限制(每个进程最多NR_OPEN个).
+ */
+static struct kmem_cache *file_cachep = NULL;
+
+/* 当前在用的文件结构数. */
+int nr_files = 0;
+
+/* 空闲的文件结构全部清零(引用计数为0). */
+static void file_ctor(void *obj)
+{
+    memset(obj, 0, sizeof(struct file));
+}
+
+/* 建立文件结构缓存。在mount_root()中调用. */
+void file_table_init(void)
+{
+    file_cachep = kmem_cache_create("file", sizeof(struct file), file_ctor);
+}
 
-/* 文件表数组(64项). */
-struct file file_table[NR_FILE];
+/**
+ * 取一个空闲的文件结构，其引用计数置为1，其它字段都是0。内存不够时返回NULL.
+ */
+struct file *get_empty_filp(void)
+{
+    struct file *f;
+
+    if (!(f = (struct file *)kmem_cache_alloc(file_cachep)))
+        return NULL;
+
+    f->f_count = 1;
+    nr_files++;
+
+    return f;
+}
+
+/**
+ * 释放文件结构f(引用计数已经或将要不用)。清零后还给缓存，保持构造后的状态.
+ */
+void put_filp(struct file *f)
+{
+    memset(f, 0, sizeof(struct file));
+    nr_files--;
+    kmem_cache_free(file_cachep, f);
+}
@@ -259,22 +259,13 @@ int sys_open(const char *filename, int flag, int mode)
 
     /* 设置执行时关闭文件句柄位图，复位对应比特位. */
     current->close_on_exec &= ~(1 << fd);
-    f = 0 + file_table;
 
-    /*  */
-    /**
-     * 令f指向文件表数组开始处。搜索空闲文件结构项(句柄引用计数为0的项)，若
-     * 已经没有空闲文件表结构项，则返回出错码.
-     */
-    for (i = 0; i < NR_FILE; i++, f++)
-        if (!f->f_count)
-            break;
-
-    if (i >= NR_FILE)
-        return -EINVAL;
+    /* 取一个空闲文件结构(引用计数为1)，内存不够则返回出错码. */
+    if (!(f = get_empty_filp()))
+        return -ENFILE;
 
-    /* 让进程的对应文件句柄的文件结构指针指向搜索到的文件结构，并令句柄引用计数递增1. */
-    (current->filp[fd] = f)->f_count++;
+    /* 让进程的对应文件句柄的文件结构指针指向该文件结构. */
+    current->filp[fd] = f;
 
     /**
      * 调用函数执行打开操作，若返回值小于0，则说明出错，释放刚申请到的文件结构，
@@ -283,7 +274,7 @@ int sys_open(const char *filename, int flag, int mode)
     if ((i = open_namei(filename, flag, mode, &inode)) < 0)
     {
         current->filp[fd] = NULL;
-        f->f_count = 0;
+        put_filp(f);
         return i;
     }
 
@@ -311,7 +302,7 @@ int sys_open(const char *filename, int flag, int mode)
             {
                 iput(inode);
                 current->filp[fd] = NULL;
-                f->f_count = 0;
+                put_filp(f);
                 return -EPERM;
             }
 
@@ -377,12 +368,13 @@ int sys_close(unsigned int fd)
 
     /**
      * 否则将对应文件结构的句柄引用计数减1，如果还不为0，则返回0(成功)。若已等于0，
-     * 说明该文件已经没有句柄引用，则释放该文件inode，返回0.
+     * 说明该文件已经没有句柄引用，则释放该文件inode和文件结构，返回0.
      */
     if (--filp->f_count)
         return (0);
 
     iput(filp->f_inode);
+    put_filp(filp);
 
     return (0);
 }
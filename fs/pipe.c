@@ -153,20 +153,16 @@ int sys_pipe(unsigned long *fildes)
     int fd[2];
     int i, j;
 
-    /* 从系统文件表中取两个空闲项(引用计数字段为0的项)，并分别设置引用计数为1. */
-    j = 0;
-
-    for (i = 0; j < 2 && i < NR_FILE; i++)
-        if (!file_table[i].f_count)
-            (f[j++] = i + file_table)->f_count++;
-
-    /* 如果只有一个空闲项，则释放该项(引用计数复位). */
-    if (j == 1)
-        f[0]->f_count = 0;
+    /* 取两个空闲文件结构(引用计数为1). */
+    if (!(f[0] = get_empty_filp()))
+        return -1;
 
-    /* 如果没有找到两个空闲项，则返回-1. */
-    if (j < 2)
+    /* 如果只取到一个，则释放它，返回-1. */
+    if (!(f[1] = get_empty_filp()))
+    {
+        put_filp(f[0]);
         return -1;
+    }
 
     /**
      * 针对上面取得的两个文件结构项，分别分配一文件句柄，并使进程的文件结构指针
@@ -191,7 +187,8 @@ int sys_pipe(unsigned long *fildes)
      */
     if (j < 2)
     {
-        f[0]->f_count = f[1]->f_count = 0;
+        put_filp(f[0]);
+        put_filp(f[1]);
         return -1;
     }
 
@@ -203,7 +200,8 @@ int sys_pipe(unsigned long *fildes)
     {
         current->filp[fd[0]] =
             current->filp[fd[1]] = NULL;
-        f[0]->f_count = f[1]->f_count = 0;
+        put_filp(f[0]);
+        put_filp(f[1]);
 
         return -1;
     }
@@ -42,9 +42,9 @@ static void lock_super(struct super_block *sb)
     /* 关中断. */
     cli();
 
-    /* 如果该超级块已经上锁，则睡眠等待. */
+    /* 如果该超级块已经上锁，则睡眠(独占地)等待. */
     while (sb->s_lock)
-        sleep_on(&(sb->s_wait));
+        sleep_on_exclusive(&(sb->s_wait));
 
     /* 给该超级块加锁(置锁定标志). */
     sb->s_lock = 1;
@@ -484,12 +484,8 @@ void mount_root(void)
     if (32 != sizeof(struct d_inode))
         panic("bad i-node size");
 
-    /**
-     * 初始化文件表数组(共64项，也即系统同时只能打开64个文件)，将所有文件结构\
-     * 中的引用计数设置为0。[??为什么放在这里初始化？].
-     */
-    for (i = 0; i < NR_FILE; i++)
-        file_table[i].f_count = 0;
+    /* 建立文件结构的对象缓存(文件结构不再是固定大小的数组). */
+    file_table_init();
 
     /**
      * 如果根文件系统所在设备是软盘的话，就提示"插入根文件系统盘，并按回车键"，
@@ -98,6 +98,9 @@ void truncate(struct m_inode *inode)
     if (!(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode)))
         return;
 
+    /* 文件的所有页面都从执行文件页面缓存中作废. */
+    invalidate_cache_pages(inode, 0, 0);
+
     /* 释放inode的7个直接逻辑块，并将这7个逻辑块项全置零. */
     for (i = 0; i < 7; i++)
         /* 如果块号不为0，则释放. */
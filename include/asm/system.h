@@ -17,6 +17,10 @@
 #define cli()                   __asm__("cli" ::)
 #define nop()                   __asm__("nop" ::)
 
+/* 保存和恢复标志寄存器(主要是中断允许标志IF)，用于可能在中断处理程序中调用的函数. */
+#define save_flags(x)           __asm__ __volatile__("pushfl ; popl %0" : "=r"(x))
+#define restore_flags(x)        __asm__ __volatile__("pushl %0 ; popfl" ::"r"(x))
+
 #define iret()                  __asm__("iret" ::)
 
 #define _set_gate(gate_addr, type, dpl, addr)                   \
@@ -18,6 +18,21 @@
 /*#define KBD_FR */
 #define KBD_FINNISH
 
+/*
+ * HZ is the frequency of the timer interrupt, i.e. the length of a
+ * jiffy. It must be between 19 and 1000 (the 8253 counter is 16 bits).
+ * Timeslices are kept in 10ms units and times() reports CLOCKS_PER_SEC
+ * ticks whatever HZ is, so only the timer granularity changes.
+ */
+#define HZ 100
+
+/*
+ * Define NO_HZ_IDLE to stop the periodic timer interrupt while the
+ * system is idle: task 0 then programs the 8253 one-shot for the next
+ * pending timer and halts. Leave it undefined for a plain periodic tick.
+ */
+#define NO_HZ_IDLE
+
 /*
  * Normally, Linux can get the drive parameters from the BIOS at
  * startup, but if this for some unfathomable reason fails, you'd
@@ -7,6 +7,7 @@
 #define _FS_H
 
 #include <sys/types.h>
+#include <linux/wait.h>
 
 /* devices are as follows: (same as minix, so we can use the minix
  * file system. These are major numbers.)
@@ -42,7 +43,6 @@ void buffer_init(long buffer_end);
 
 #define NR_OPEN                 20
 #define NR_INODE                32
-#define NR_FILE                 64
 #define NR_SUPER                8
 #define NR_HASH                 307
 #define NR_BUFFERS              nr_buffers
@@ -74,7 +74,7 @@ struct buffer_head
     unsigned char b_dirt;  /* 0-clean,1-dirty */
     unsigned char b_count; /* users using this block */
     unsigned char b_lock;  /* 0 - ok, 1 -locked */
-    struct task_struct *b_wait;
+    struct wait_queue *b_wait;
     struct buffer_head *b_prev;
     struct buffer_head *b_next;
     struct buffer_head *b_prev_free;
@@ -102,7 +102,7 @@ struct m_inode
     unsigned char i_nlinks;
     unsigned short i_zone[9];
     /* these are in memory also */
-    struct task_struct *i_wait;
+    struct wait_queue *i_wait;
     unsigned long i_atime;
     unsigned long i_ctime;
     unsigned short i_dev;
@@ -142,7 +142,7 @@ struct super_block
     struct m_inode *s_isup;
     struct m_inode *s_imount;
     unsigned long s_time;
-    struct task_struct *s_wait;
+    struct wait_queue *s_wait;
     unsigned char s_lock;
     unsigned char s_rd_only;
     unsigned char s_dirt;
@@ -167,7 +167,10 @@ struct dir_entry
 };
 
 extern struct m_inode inode_table[NR_INODE];
-extern struct file file_table[NR_FILE];
+extern int nr_files;
+extern void file_table_init(void);
+extern struct file *get_empty_filp(void);
+extern void put_filp(struct file *f);
 extern struct super_block super_block[NR_SUPER];
 extern struct buffer_head *start_buffer;
 extern int nr_buffers;
@@ -192,9 +195,10 @@ extern struct m_inode *get_pipe_inode(void);
 extern struct buffer_head *get_hash_table(int dev, int block);
 extern struct buffer_head *getblk(int dev, int block);
 extern void ll_rw_block(int rw, struct buffer_head *bh);
+extern int ll_rw_page(int rw, int dev, int page, char *buffer);
 extern void brelse(struct buffer_head *buf);
 extern struct buffer_head *bread(int dev, int block);
-extern void bread_page(unsigned long addr, int dev, int b[4]);
+extern int bread_page(unsigned long addr, int dev, int b[4]);
 extern struct buffer_head *breada(int dev, int block, ...);
 extern int new_block(int dev);
 extern void free_block(int dev, int block);
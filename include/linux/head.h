@@ -9,6 +9,16 @@ typedef struct desc_struct
 extern unsigned long pg_dir[1024];
 extern desc_table idt, gdt;
 
+/* CPU族号(3表示386，4表示486...)，由head.s检测. */
+extern int x86;
+/* CPU特性标志(cpuid功能号1返回的edx，没有cpuid指令时为0)，由head.s检测. */
+extern unsigned long cpu_features;
+
+#define CPU_PSE                 0x00000008  /* 4MB页. */
+#define CPU_TSC                 0x00000010  /* 时间戳计数器(rdtsc指令). */
+#define CPU_APIC                0x00000200  /* 片上本地APIC. */
+#define CPU_PGE                 0x00002000  /* 全局页. */
+
 #define GDT_NUL                 0
 #define GDT_CODE                1
 #define GDT_DATA                2
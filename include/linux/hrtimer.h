@@ -0,0 +1,35 @@
+#ifndef _HRTIMER_H
+#define _HRTIMER_H
+
+/**
+ * 高精度定时器(kernel/hrtimer.c)。时间是开机以来的纳秒数(64位)，由TSC计算，
+ * 精度不受时钟滴答限制。到期时在中断处理程序中调用function(data)，调用之前定时器
+ * 已经取下.
+ */
+struct hrtimer
+{
+    struct hrtimer *next;
+    struct hrtimer **pprev;         /* NULL表示定时器没有挂上. */
+    unsigned long long expires;
+    unsigned long data;
+    void (*function)(unsigned long);
+};
+
+#define NSEC_PER_SEC            1000000000L
+
+#define init_hrtimer(t)         ((t)->next = NULL, (t)->pprev = NULL)
+#define hrtimer_pending(t)      ((t)->pprev != NULL)
+
+/* 读取时间戳计数器. */
+#define rdtsc(low, high)        __asm__ __volatile__(".byte 0x0f,0x31" : "=a"(low), "=d"(high))
+
+extern unsigned long tsc_khz;
+
+extern void hrtimer_init(void);
+extern unsigned long long ktime_get(void);
+extern void hrtimer_start(struct hrtimer *timer, unsigned long long expires);
+extern int hrtimer_cancel(struct hrtimer *timer);
+extern int run_hrtimers(void);
+extern int hrtimer_needs_tick(void);
+
+#endif
@@ -11,6 +11,14 @@ void free_s(void *obj, int size);
 
 #define free(x)                 free_s((x), 0)
 
+/* 对象缓存(lib/malloc.c). */
+struct kmem_cache;
+struct kmem_cache *kmem_cache_create(const char *name, int size, void (*ctor)(void *));
+void *kmem_cache_alloc(struct kmem_cache *cachep);
+void kmem_cache_free(struct kmem_cache *cachep, void *obj);
+int kmem_cache_shrink(struct kmem_cache *cachep);
+int kmem_shrink(void);
+
 /*
  * This is defined as a macro, but at some point this might become a
  * real subroutine that sets a flag if it returns true (to do
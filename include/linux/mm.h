@@ -3,8 +3,160 @@
 
 #define PAGE_SIZE               4096
 
+/**
+ * 内核能使用的物理内存上限。内核页表恒等映射物理内存，且必须位于任务0的64MB
+ * 线性地址空间之内(任务1从64MB处开始)，所以最多为64MB.
+ */
+#define MAX_MEMORY              (64 * 1024 * 1024)
+
+/* BIOS INT 0x15/E820h内存映射表项(由setup.s保存在0x900A4处，最多E820_MAX项). */
+#define E820_MAX                16
+#define E820_RAM                1   /* 可用内存. */
+
+struct e820entry
+{
+    unsigned long addr;     /* 区域起始地址低32位. */
+    unsigned long addr_hi;  /* 区域起始地址高32位. */
+    unsigned long size;     /* 区域长度低32位. */
+    unsigned long size_hi;  /* 区域长度高32位. */
+    unsigned long type;     /* 区域类型. */
+};
+
+/**
+ * 刷新页变换高速缓冲宏函数。
+ * 为了提高地址转换的效率，CPU 将最近使用的页表数据存放在芯片中高速缓冲中。
+ * 在修改过页表信息之后，就需要刷新该缓冲区。这里使用重新加载页目录基址寄存器
+ * cr3 的方法来进行刷新,下面eax = 0，是页目录的基址.
+ * 有多个处理器时，其它处理器的TLB也要刷新(smp_flush_tlb()，kernel/smp.c)；
+ * 带__的版本只刷新本处理器，用于连续刷新多页，最后再统一通知其它处理器.
+ */
+#define __invalidate() \
+    __asm__("movl %%eax,%%cr3" ::"a"(0))
+
+#define invalidate()                                                          \
+    do                                                                        \
+    {                                                                         \
+        __invalidate();                                                       \
+        smp_flush_tlb();                                                      \
+    } while (0)
+
+/**
+ * 只刷新线性地址addr所在页面的TLB项，用于只改了一个页表项的情况。invlpg是486才有
+ * 的指令，386上只能重新加载cr3(x86在head.s中检测，见linux/head.h).
+ */
+#define __invalidate_page(addr)                                               \
+    do                                                                        \
+    {                                                                         \
+        if (x86 >= 4)                                                         \
+            __asm__ __volatile__("invlpg (%0)" ::"r"(addr) : "memory");       \
+        else                                                                  \
+            __invalidate();                                                   \
+    } while (0)
+
+#define invalidate_page(addr)                                                 \
+    do                                                                        \
+    {                                                                         \
+        __invalidate_page(addr);                                              \
+        smp_flush_tlb();                                                      \
+    } while (0)
+
+extern void smp_flush_tlb(void);
+
+/* 一次逐页刷新的最多页数，超过时重新加载cr3更划算. */
+#define INVLPG_MAX              32
+
+/**
+ * 下面定义若需要改动，则需要与head.s等文件中的相关信息一起改变.
+ * 物理内存最多可用到MAX_MEMORY，实际大小由setup.s检测得到，
+ * mem_map[]等数组和16MB以上的内核页表都在paging_init()中按实际内存大小建立.
+ */
+/* 内存低端(1MB). */
+#define LOW_MEM                 0x100000
+/* 分页内存的最大值. */
+#define PAGING_MEMORY           (MAX_MEMORY - LOW_MEM)
+/* 分页后的物理内存页数(实际值，由paging_init()设置). */
+#define PAGING_PAGES            paging_pages
+/* 指定内存地址映射为页号. */
+#define MAP_NR(addr)            (((addr)-LOW_MEM) >> 12)
+/* 页面被占用标志. */
+#define USED                    100
+
+/* 页表项中的标志位. */
+#define PAGE_DIRTY              0x40
+#define PAGE_ACCESSED           0x20
+#define PAGE_PCD                0x10    /* 不缓存，用于设备寄存器. */
+#define PAGE_PWT                0x08
+#define PAGE_USER               0x04
+#define PAGE_RW                 0x02
+#define PAGE_PRESENT            0x01
+/* 页目录项中的4MB页标志(PS)，以及全局页标志(G). */
+#define PAGE_4M                 0x80
+#define PAGE_GLOBAL             0x100
+/* 位9留给操作系统使用，这里标记属于共享文件映射区的页面(见mm/mmap.c). */
+#define PAGE_SHARED_MMAP        0x200
+
+/**
+ * 文件映射区(mm/mmap.c)。start、end是进程的逻辑地址(相对于段基址)，按页对齐，
+ * end为0表示空闲项。不指定地址的映射放在MMAP_START到MMAP_END之间.
+ */
+#define NR_MMAP                 8
+#define MMAP_START              0x2000000
+#define MMAP_END                0x3000000
+
+struct vm_area
+{
+    unsigned long start, end;       /* 映射区的逻辑地址范围[start, end). */
+    unsigned long offset;           /* start处对应的文件偏移. */
+    struct m_inode *inode;          /* 被映射的文件. */
+    unsigned short prot, flags;     /* PROT_*和MAP_*，见sys/mman.h. */
+};
+
+extern unsigned long HIGH_MEMORY;
+/* 系统中所有进程的缺页统计，见sched.h中task_struct的同名字段. */
+extern long total_min_flt, total_maj_flt, total_cow_flt;
+/* 记录当前进程的一次缺页(type是min_flt、maj_flt或cow_flt)，同时计入系统总计. */
+#define count_fault(type)       (current->type++, total_##type++)
+extern long paging_pages;
+extern unsigned char *mem_map;
+extern long nr_free_pages;
+
 extern unsigned long get_free_page(void);
+extern unsigned long get_free_page_atomic(void);
+extern unsigned long get_free_pages(int order);
+extern int fill_zero_pool(void);
 extern unsigned long put_page(unsigned long page, unsigned long address);
+extern unsigned long put_dirty_page(unsigned long page, unsigned long address);
 extern void free_page(unsigned long addr);
+extern void free_pages(unsigned long addr, int order);
+extern long paging_init(long start_mem, long end_mem);
+extern void mem_init(long start_mem, long end_mem,
+                     struct e820entry *map, int nr_map);
+extern volatile void oom(void);
+extern void invalidate_range(unsigned long start, unsigned long end);
+extern unsigned long *get_page_entry(unsigned long address);
+extern void unshare_page_table(unsigned long *dir);
+
+extern struct vm_area *find_vma(unsigned long addr);
+extern int do_mmap_page(unsigned long address);
+extern int mmap_wp_page(unsigned long address, unsigned long *table_entry);
+
+/**
+ * 页面交换(mm/swap.c)。不存在(P=0)但内容不为0的页表项表示页面已被换出，
+ * 其值为交换页号左移1位.
+ */
+extern int swap_out(void);
+extern int swap_in(unsigned long *table_ptr);
+extern void swap_free(int swap_nr);
+extern int read_swap_page(int swap_nr, char *buffer);
+
+/**
+ * 执行文件页面缓存(mm/page_cache.c)。偏移是页面在执行映像中的偏移(文件偏移减去
+ * 1块的执行文件头).
+ */
+extern unsigned long find_cache_page(struct m_inode *inode, unsigned long offset);
+extern int add_cache_page(struct m_inode *inode, unsigned long offset, unsigned long page);
+extern void invalidate_cache_pages(struct m_inode *inode, unsigned long pos,
+                                   unsigned long count);
+extern int shrink_page_cache(void);
 
 #endif
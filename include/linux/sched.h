@@ -1,8 +1,21 @@
-#ifndef _SCHED_H
-#define _SCHED_H
+#ifndef _LINUX_SCHED_H
+#define _LINUX_SCHED_H
+
+#include <linux/config.h>
 
 #define NR_TASKS                64
+
+/* 时钟频率在linux/config.h中设置. */
+#ifndef HZ
 #define HZ                      100
+#endif
+
+#if HZ < 19 || HZ > 1000
+#error "HZ must be between 19 and 1000"
+#endif
+
+/* 滴答数与times()等返回给用户的时钟数(CLOCKS_PER_SEC=100)之间的转换，先除以避免溢出. */
+#define jiffies_to_clock_t(x)   ((x) / HZ * 100 + (x) % HZ * 100 / HZ)
 
 #define FIRST_TASK              task[0]
 #define LAST_TASK               task[NR_TASKS - 1]
@@ -10,7 +23,10 @@
 #include <linux/head.h>
 #include <linux/fs.h>
 #include <linux/mm.h>
+#include <linux/timer.h>
+#include <linux/smp.h>
 #include <signal.h>
+#include <sched.h>
 
 #if (NR_OPEN > 32)
 #error "Currently the close-on-exec-flags are in one word, max 32 files/proc"
@@ -22,15 +38,21 @@
 #define TASK_ZOMBIE             3
 #define TASK_STOPPED            4
 
+/* 任务的默认优先级(时间片滴答数)，nice()会降低它. */
+#define DEF_PRIORITY            15
+
 #ifndef NULL
 #define NULL                    ((void *)0)
 #endif
 
 extern int copy_page_tables(unsigned long from, unsigned long to, long size);
 extern int free_page_tables(unsigned long from, unsigned long size);
+extern void vfork_release(struct task_struct *p);
+extern void exit_mmap(struct task_struct *p);
 
 extern void sched_init(void);
 extern void schedule(void);
+extern void cpu_idle(void);
 extern void trap_init(void);
 extern void panic(const char *str);
 extern int tty_write(unsigned minor, char *buf, int count);
@@ -77,6 +99,9 @@ struct tss_struct
     struct i387_struct i387;
 };
 
+/* 就绪队列组(kernel/sched.c). */
+struct prio_array;
+
 struct task_struct
 {
     /* these are hardcoded - don't touch */
@@ -86,6 +111,8 @@ struct task_struct
     long signal;
     struct sigaction sigaction[32];
     long blocked; /* bitmap of masked signals */
+    /* 需要重新调度(有更高优先级的实时任务就绪)，返回用户态之前检查(kernel/system_call.s). */
+    long need_resched;
                   /* various fields */
     int exit_code;
     unsigned long start_code, end_code, end_data, brk, start_stack;
@@ -94,7 +121,26 @@ struct task_struct
     unsigned short gid, egid, sgid;
     long alarm;
     long utime, stime, cutime, cstime, start_time;
+    /* 内存统计：驻留页数，不需读盘的缺页、需要读盘的缺页和写保护异常的次数. */
+    long rss, min_flt, maj_flt, cow_flt;
+    /* 主动(睡眠)和被动(时间片用完或被抢占)让出处理器的次数，以及最近一次被唤醒的时刻(纳秒). */
+    long nvcsw, nivcsw;
+    unsigned long long wake_time;
+    /* 就绪队列(见kernel/sched.c)：链表指针、所在的队列组，以及counter最后重新计算时的轮次. */
+    struct task_struct *run_next, *run_prev;
+    struct prio_array *run_array;
+    long run_epoch;
+    /* 调度策略(SCHED_OTHER等，见<sched.h>)和实时任务的静态优先级. */
+    int policy;
+    int rt_priority;
+    /* 任务所属的处理器(fork时分配，不再改变)，以及切换出去时持有内核大锁的嵌套深度(-1表示新建的任务). */
+    int processor;
+    int lock_depth;
+    /* alarm定时器，到期时发SIGALRM信号. */
+    struct timer_list real_timer;
     unsigned short used_math;
+    /* vfork()产生的子进程在执行execve()或退出之前借用父进程的地址空间，这里指向该父进程. */
+    struct task_struct *vfork_parent;
     /* file system info */
     int tty; /* -1 if no tty, so it must be signed */
     unsigned short umask;
@@ -103,9 +149,14 @@ struct task_struct
     struct m_inode *executable;
     unsigned long close_on_exec;
     struct file *filp[NR_OPEN];
+    /* 文件映射区(mmap) */
+    struct vm_area mmap[NR_MMAP];
     /* ldt for this task 0 - zero 1 - cs 2 - ds&ss */
     struct desc_struct ldt[3];
-    /* tss for this task */
+    /**
+     * 任务的切换现场(已不是处理器使用的TSS，见switch_to())：esp、eip是切换出去时的
+     * 内核栈顶和恢复地址，esp0是内核堆栈底，还有fs、gs、cr3和协处理器状态.
+     */
     struct tss_struct tss;
 };
 
@@ -119,9 +170,12 @@ struct task_struct
             /* signals */ 0, {                                                                                                                                                                                         \
                                  {},                                                                                                                                                                                   \
                              },                                                                                                                                                                                        \
-            0, /* ec,brk... */ 0, 0, 0, 0, 0, 0, /* pid etc.. */ 0, -1, 0, 0, 0, /* uid etc */ 0, 0, 0, 0, 0, 0, /* alarm */ 0, 0, 0, 0, 0, 0, /* math */ 0, /* fs info */ -1, 0022, NULL, NULL, NULL, 0, /* filp */ { \
+            0, /* resched */ 0, /* ec,brk... */ 0, 0, 0, 0, 0, 0, /* pid etc.. */ 0, -1, 0, 0, 0, /* uid etc */ 0, 0, 0, 0, 0, 0, /* alarm */ 0, 0, 0, 0, 0, 0, /* rss */ 0, 0, 0, 0, /* csw */ 0, 0, 0, /* run */ NULL, NULL, NULL, 0, /* policy */ SCHED_OTHER, 0, /* smp */ 0, 0, /* timer */ {NULL, NULL, 0, 0, NULL}, /* math */ 0, /* vfork */ NULL, /* fs info */ -1, 0022, NULL, NULL, NULL, 0, /* filp */ { \
                                                                                                                                                                                                            NULL,       \
                                                                                                                                                                                                        },              \
+            /* mmap */ {                                                                                                                                                                                               \
+                {0, 0, 0, NULL, 0, 0},                                                                                                                                                                                 \
+            },                                                                                                                                                                                                         \
             {                                                                                                                                                                                                          \
                 {0, 0},                                                                                                                                                                                                \
                 /* ldt */ {0x9f, 0xc0fa00},                                                                                                                                                                            \
@@ -131,21 +185,49 @@ struct task_struct
     }
 
 extern struct task_struct *task[NR_TASKS];
-extern struct task_struct *last_task_used_math;
-extern struct task_struct *current;
+/**
+ * 线性地址address所在进程的驻留页数加n。vfork()的子进程借用的父进程的空间算在父进程
+ * 上；fork()复制页表失败时进程槽可能已被清除，这时不计.
+ */
+#define rss_add(address, n)                                                   \
+    do                                                                        \
+    {                                                                         \
+        struct task_struct *__p = task[(unsigned long)(address) >> 26];       \
+        if (__p)                                                              \
+            __p->rss += (n);                                                  \
+    } while (0)
+/* 各处理器的当前任务和最后使用协处理器的任务. */
+extern struct task_struct *current_set[NR_CPUS];
+extern struct task_struct *math_owner[NR_CPUS];
+
+#define current                 (current_set[smp_processor_id()])
+#define last_task_used_math     (math_owner[smp_processor_id()])
 extern long volatile jiffies;
 extern long startup_time;
 
 #define CURRENT_TIME            (startup_time + jiffies / HZ)
 
-extern void add_timer(long jiffies, void (*fn)(void));
-extern void sleep_on(struct task_struct **p);
-extern void interruptible_sleep_on(struct task_struct **p);
-extern void wake_up(struct task_struct **p);
+extern void sleep_on(struct wait_queue **q);
+extern void sleep_on_exclusive(struct wait_queue **q);
+extern void interruptible_sleep_on(struct wait_queue **q);
+extern void __wake_up(struct wait_queue **q, int nr_exclusive);
+
+#define wake_up(q)              __wake_up((q), 1)
+#define wake_up_all(q)          __wake_up((q), 0)
+extern void wake_up_process(struct task_struct *p);
+extern void signal_wake_up(struct task_struct *p);
+extern void sched_fork(struct task_struct *p);
+extern void sched_exit(struct task_struct *p);
+extern void init_idle(struct task_struct *idle, int cpu);
+extern void update_process_times(long cpl);
+extern unsigned long long trace_sched_event(int type, struct task_struct *p, struct task_struct *other);
+extern void account_wakeup_latency(unsigned long long ns);
+extern void set_alarm(struct task_struct *p, long expires);
 
 /*
  * Entry into gdt where to find first TSS. 0-nul, 1-cs, 2-ds, 3-syscall
  * 4-TSS0, 5-LDT0, 6-TSS1 etc ...
+ * 现在每个处理器(而不是每个任务)一对：n是处理器号，见cpu_init().
  */
 #define FIRST_TSS_ENTRY         4
 #define FIRST_LDT_ENTRY         (FIRST_TSS_ENTRY + 1)
@@ -159,30 +241,49 @@ extern void wake_up(struct task_struct **p);
             "shrl $4,%%eax"     \
             : "=a"(n)           \
             : "a"(0), "i"(FIRST_TSS_ENTRY << 3))
+
+extern void cpu_init(int cpu);
+extern void load_ldt(void);
+extern void __switch_to(struct task_struct *prev, struct task_struct *next);
+
+/* 任务结构中切换现场(tss.esp和tss.eip)的偏移，供switch_to()的汇编使用. */
+#define TASK_ESP                ((long)&((struct task_struct *)0)->tss.esp)
+#define TASK_EIP                ((long)&((struct task_struct *)0)->tss.eip)
+
 /*
- *	switch_to(n) should switch tasks to task nr n, first
- * checking that n isn't the current task, in which case it does nothing.
- * This also clears the TS-flag if the task we switched to has used
- * tha math co-processor latest.
+ *	switch_to(p) should switch tasks to task p, first
+ * checking that p isn't the current task, in which case it does nothing.
+ * 当前任务是按处理器记录的，所以在切换之前由C代码设置；任务切换回来时current已由
+ * 切换者设为本任务.
+ *
+ * 不再用TSS做硬件任务切换：ebp压在当前任务的内核堆栈上(其它寄存器由编译器保存)，
+ * 栈顶和恢复地址记在tss.esp、tss.eip中，换到p的内核堆栈后由__switch_to()
+ * (kernel/sched.c)设置本处理器TSS中的esp0、LDT、fs/gs和TS位，返回到p上次切换出去
+ * 的地方(新建的任务是ret_from_fork)。__switch_to()的两个参数留在p的堆栈上，由恢复
+ * 处弹出.
  */
-#define switch_to(n)                                  \
-    {                                                 \
-        struct                                        \
-        {                                             \
-            long a, b;                                \
-        } __tmp;                                      \
-        __asm__("cmpl %%ecx,_current\n\t"             \
-                "je 1f\n\t"                           \
-                "movw %%dx,%1\n\t"                    \
-                "xchgl %%ecx,_current\n\t"            \
-                "ljmp %0\n\t"                         \
-                "cmpl %%ecx,_last_task_used_math\n\t" \
-                "jne 1f\n\t"                          \
-                "clts\n"                              \
-                "1:" ::"m"(*&__tmp.a),                \
-                "m"(*&__tmp.b),                       \
-                "d"(_TSS(n)), "c"((long)task[n]));    \
-    }
+#define switch_to(p)                                                          \
+    do                                                                        \
+    {                                                                         \
+        struct task_struct *__prev = current, *__next = (p);                  \
+        if (__next != __prev)                                                 \
+        {                                                                     \
+            current = __next;                                                 \
+            __asm__ __volatile__("pushl %%ebp\n\t"                            \
+                                 "movl %%esp,%c2(%0)\n\t"                    \
+                                 "movl $1f,%c3(%0)\n\t"                      \
+                                 "movl %c2(%1),%%esp\n\t"                    \
+                                 "pushl %1\n\t"                               \
+                                 "pushl %0\n\t"                               \
+                                 "pushl %c3(%1)\n\t"                          \
+                                 "jmp ___switch_to\n"                         \
+                                 "1:\taddl $8,%%esp\n\t"                      \
+                                 "popl %%ebp"                                 \
+                                 : "+S"(__prev), "+D"(__next)                 \
+                                 : "i"(TASK_ESP), "i"(TASK_EIP)               \
+                                 : "ax", "bx", "cx", "dx", "memory");         \
+        }                                                                     \
+    } while (0)
 
 #define PAGE_ALIGN(n)           (((n) + 0xfff) & 0xfffff000)
 
@@ -0,0 +1,61 @@
+#ifndef _SMP_H
+#define _SMP_H
+
+#include <linux/mm.h>
+
+/**
+ * 多处理器支持(kernel/smp.c)。按Intel多处理器规范(MP)的配置表找到其它处理器，
+ * 经本地APIC启动它们。每个处理器有自己的当前任务、空闲任务和就绪队列；内核由一把
+ * 大锁保护，同一时刻只有一个处理器在执行内核代码。外部中断仍然只送到引导处理器.
+ */
+#define NR_CPUS                 8
+#define NO_PROC_ID              0xff
+
+/**
+ * 本地APIC的寄存器映射在任务0线性空间的最后一页(物理内存因此最多用到FIXMAP_START)，
+ * 只在找到多个处理器时才映射.
+ */
+#define FIXMAP_START            (MAX_MEMORY - 0x400000)
+#define APIC_VADDR              (MAX_MEMORY - PAGE_SIZE)
+
+/* 本地APIC寄存器(相对映射基址的偏移). */
+#define APIC_ID                 0x20
+#define APIC_TPR                0x80
+#define APIC_EOI                0xB0
+#define APIC_SPIV               0xF0
+#define APIC_ICR                0x300
+#define APIC_ICR2               0x310
+#define APIC_LVTT               0x320
+#define APIC_LVT0               0x350
+#define APIC_LVT1               0x360
+#define APIC_TMICT              0x380
+#define APIC_TMCCT              0x390
+#define APIC_TDCR               0x3E0
+
+/* 本地APIC定时器和处理器间中断使用的中断向量. */
+#define LOCAL_TIMER_VECTOR      0x30
+#define RESCHEDULE_VECTOR       0x31
+#define INVALIDATE_VECTOR       0x32
+#define SPURIOUS_VECTOR         0xff
+
+#define apic_read(reg)          (*(volatile unsigned long *)(apic_base + (reg)))
+#define apic_write(reg, v)      (*(volatile unsigned long *)(apic_base + (reg)) = (v))
+
+extern unsigned long apic_base;
+extern int smp_num_cpus;
+extern unsigned char apic_to_cpu[256];
+extern int kernel_lock_depth;
+
+/* 当前处理器的编号(0是引导处理器)。只有一个处理器时不必读APIC. */
+#define smp_processor_id()      (smp_num_cpus > 1 ? apic_to_cpu[apic_read(APIC_ID) >> 24] : 0)
+
+extern int smp_scan(void);
+extern void smp_boot_cpus(void);
+extern void smp_flush_tlb(void);
+extern void smp_send_reschedule(int cpu);
+extern void lock_kernel(void);
+extern void unlock_kernel(void);
+extern int release_kernel_lock(void);
+extern void reacquire_kernel_lock(int depth);
+
+#endif
@@ -70,6 +70,18 @@ extern int sys_sgetmask();
 extern int sys_ssetmask();
 extern int sys_setreuid();
 extern int sys_setregid();
+extern int sys_swapon();
+extern int sys_vfork();
+extern int sys_mmap();
+extern int sys_munmap();
+extern int sys_vtimes();
+extern int sys_nanosleep();
+extern int sys_clock_gettime();
+extern int sys_sched_setscheduler();
+extern int sys_sched_getscheduler();
+extern int sys_sched_setparam();
+extern int sys_sched_getparam();
+extern int sys_sched_trace();
 
 fn_ptr sys_call_table[] = {
     sys_setup,  sys_exit,   sys_fork,   sys_read,
@@ -84,5 +96,8 @@ fn_ptr sys_call_table[] = {
     sys_lock,   sys_ioctl,  sys_fcntl,  sys_mpx,    sys_setpgid,sys_ulimit,
     sys_uname,  sys_umask,  sys_chroot, sys_ustat,  sys_dup2,   sys_getppid,
     sys_getpgrp, sys_setsid, sys_sigaction, sys_sgetmask, sys_ssetmask,
-    sys_setreuid, sys_setregid
+    sys_setreuid, sys_setregid, sys_swapon, sys_vfork,
+    sys_mmap, sys_munmap, sys_vtimes, sys_nanosleep, sys_clock_gettime,
+    sys_sched_setscheduler, sys_sched_getscheduler, sys_sched_setparam,
+    sys_sched_getparam, sys_sched_trace
 };
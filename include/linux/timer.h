@@ -0,0 +1,28 @@
+#ifndef _TIMER_H
+#define _TIMER_H
+
+/**
+ * 内核定时器。定时器结构由使用者提供(静态变量或嵌在别的结构中，不必分配)，
+ * add_timer()把它挂到定时器轮上(kernel/timer.c)，到期时在时钟中断中调用
+ * function(data)，调用之前定时器已经取下，所以处理函数可以再次添加它.
+ * expires是到期时刻的jiffies值.
+ */
+struct timer_list
+{
+    struct timer_list *next;
+    struct timer_list **pprev;      /* 指向前一项的next(或槽的表头)，NULL表示定时器没有挂上. */
+    unsigned long expires;
+    unsigned long data;
+    void (*function)(unsigned long);
+};
+
+#define init_timer(t)           ((t)->next = NULL, (t)->pprev = NULL)
+#define timer_pending(t)        ((t)->pprev != NULL)
+
+extern void add_timer(struct timer_list *timer);
+extern int del_timer(struct timer_list *timer);
+extern int mod_timer(struct timer_list *timer, unsigned long expires);
+extern void run_timers(void);
+extern long timer_idle_ticks(long max);
+
+#endif
@@ -10,6 +10,7 @@
 #define _TTY_H
 
 #include <termios.h>
+#include <linux/wait.h>
 
 #define TTY_BUF_SIZE 1024
 
@@ -18,7 +19,7 @@ struct tty_queue
     unsigned long data;
     unsigned long head;
     unsigned long tail;
-    struct task_struct *proc_list;
+    struct wait_queue *proc_list;
     char buf[TTY_BUF_SIZE];
 };
 
@@ -0,0 +1,25 @@
+#ifndef _WAIT_H
+#define _WAIT_H
+
+/**
+ * 等待队列。睡眠的任务在自己的内核栈上建一个wait_queue项，挂到队列上(循环双向
+ * 链表，队列头是指向第一项的指针，NULL表示没有任务在等待)，醒来后自己取下.
+ *
+ * 独占的等待者挂在队列尾，wake_up()唤醒所有非独占的等待者和第一个独占的等待者，
+ * 用于等待一个资源(锁、空闲缓冲区、空闲请求项)而且醒来的任务会占用它的场合，
+ * 这样释放一次资源只唤醒一个任务去争用。wake_up_all()唤醒所有等待者.
+ */
+struct task_struct;
+
+struct wait_queue
+{
+    struct task_struct *task;
+    struct wait_queue *next, *prev;
+    int flags;
+};
+
+#define WQ_FLAG_EXCLUSIVE       0x01
+
+#define waitqueue_active(q)     (*(q) != NULL)
+
+#endif
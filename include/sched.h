@@ -0,0 +1,29 @@
+#ifndef _SCHED_H
+#define _SCHED_H
+
+#include <sys/types.h>
+
+/**
+ * 调度策略。SCHED_OTHER是原来的分时调度；SCHED_FIFO和SCHED_RR是实时策略，按静态
+ * 优先级sched_priority(RT_PRIO_MIN-RT_PRIO_MAX，越大越优先)调度，总是先于分时任务
+ * 运行。FIFO任务一直运行到它睡眠、让出或被更高优先级的实时任务抢占；RR任务在同一
+ * 优先级内按时间片(与分时任务的时间片相同，由priority决定)轮转.
+ */
+#define SCHED_OTHER             0
+#define SCHED_FIFO              1
+#define SCHED_RR                2
+
+#define RT_PRIO_MIN             1
+#define RT_PRIO_MAX             31
+
+struct sched_param
+{
+    int sched_priority;             /* SCHED_OTHER必须为0. */
+};
+
+int sched_setscheduler(pid_t pid, int policy, const struct sched_param *param);
+int sched_getscheduler(pid_t pid);
+int sched_setparam(pid_t pid, const struct sched_param *param);
+int sched_getparam(pid_t pid, struct sched_param *param);
+
+#endif
@@ -17,6 +17,7 @@ typedef unsigned int sigset_t; /* 32 bits */
 #define SIGABRT                 6
 #define SIGIOT                  6
 #define SIGUNUSED               7
+#define SIGBUS                  7   /* 总线错误：缺页时读不回交换出去的页面. */
 #define SIGFPE                  8
 #define SIGKILL                 9
 #define SIGUSR1                 10
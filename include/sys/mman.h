@@ -0,0 +1,34 @@
+#ifndef _SYS_MMAN_H
+#define _SYS_MMAN_H
+
+#include <sys/types.h>
+
+/* 映射区的保护属性. */
+#define PROT_NONE               0x0
+#define PROT_READ               0x1
+#define PROT_WRITE              0x2
+#define PROT_EXEC               0x4
+
+/* 映射类型及选项. MAP_SHARED和MAP_PRIVATE必须且只能指定一个. */
+#define MAP_SHARED              0x01    /* 修改对其它映射者可见，并写回文件. */
+#define MAP_PRIVATE             0x02    /* 修改是私有的(写时复制). */
+#define MAP_TYPE                0x0f
+#define MAP_FIXED               0x10    /* 必须映射在addr处. */
+
+#define MAP_FAILED              ((void *)-1)
+
+/* 系统调用最多只有3个参数，mmap()的参数放在该结构中传给内核. */
+struct mmap_arg_struct
+{
+    unsigned long addr;
+    unsigned long len;
+    int prot;
+    int flags;
+    int fd;
+    off_t offset;
+};
+
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset);
+int munmap(void *addr, size_t len);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef _SYS_SCHED_TRACE_H
+#define _SYS_SCHED_TRACE_H
+
+#include <sys/types.h>
+
+/**
+ * 调度事件跟踪(kernel/sched_trace.c)。内核把最近的调度事件连同时间戳(开机以来的
+ * 纳秒数，见clock_gettime(CLOCK_MONOTONIC))记在一个环形缓冲区里，满了就覆盖最早的
+ * 事件；sched_trace()按发生的顺序读出并取走它们.
+ */
+#define SCHED_EV_WAKEUP         1   /* wake_up()唤醒等待队列上的任务pid，other是唤醒者. */
+#define SCHED_EV_RUNNING        2   /* 任务pid的状态变为TASK_RUNNING，other是当时的当前任务. */
+#define SCHED_EV_SWITCH         3   /* 处理器cpu从任务other切换到任务pid. */
+
+struct sched_event
+{
+    unsigned long long time;
+    short type;
+    short cpu;
+    pid_t pid;
+    pid_t other;
+};
+
+/**
+ * 唤醒延迟(从状态变为TASK_RUNNING到真正开始运行)的直方图：第0格是不到1024ns的，
+ * 第i格是[2^(i-1), 2^i)*1024ns的，最后一格还包括所有更长的.
+ */
+#define NR_LAT_BUCKETS          24
+
+struct sched_trace_stat
+{
+    unsigned long lost;                     /* 因缓冲区满被覆盖的事件数. */
+    unsigned long latency[NR_LAT_BUCKETS];
+};
+
+extern int sched_trace(struct sched_event *buf, int count, struct sched_trace_stat *st);
+
+#endif
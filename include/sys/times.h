@@ -11,6 +11,23 @@ struct tms
     time_t tms_cstime;
 };
 
+/* vtimes()返回的当前进程的内存统计(单位是页或次数)、上下文切换次数以及系统总计. */
+struct vtms
+{
+    long vt_rss;            /* 驻留页数. */
+    long vt_minflt;         /* 不需读盘的缺页次数. */
+    long vt_majflt;         /* 需要读盘(执行文件、映射文件或交换空间)的缺页次数. */
+    long vt_cowflt;         /* 写保护(写时复制)异常次数. */
+    long vt_nvcsw;          /* 主动让出处理器(睡眠)的次数. */
+    long vt_nivcsw;         /* 被动让出处理器(时间片用完或被抢占)的次数. */
+    long vt_total_minflt;   /* 以下是系统中所有进程的总计. */
+    long vt_total_majflt;
+    long vt_total_cowflt;
+    long vt_free_pages;     /* 空闲页数. */
+    long vt_pages;          /* 分页内存的总页数. */
+};
+
 extern time_t times(struct tms *tp);
+extern time_t vtimes(struct tms *tp, struct vtms *vp);
 
 #endif
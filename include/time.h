@@ -15,6 +15,19 @@ typedef unsigned int size_t;
 
 typedef long clock_t;
 
+/* 纳秒精度的时间，用于nanosleep()和clock_gettime(). */
+struct timespec
+{
+    time_t tv_sec;
+    long tv_nsec;
+};
+
+/* clock_gettime()的时钟. */
+#define CLOCK_REALTIME          0   /* 从1970年1月1日0时起. */
+#define CLOCK_MONOTONIC         1   /* 从开机起，不受stime()影响. */
+
+typedef int clockid_t;
+
 struct tm
 {
     int tm_sec;
@@ -39,5 +52,7 @@ struct tm *gmtime(const time_t *tp);
 struct tm *localtime(const time_t *tp);
 size_t strftime(char *s, size_t smax, const char *fmt, const struct tm *tp);
 void tzset(void);
+int nanosleep(const struct timespec *req, struct timespec *rem);
+int clock_gettime(clockid_t clk, struct timespec *tp);
 
 #endif
@@ -129,6 +129,18 @@
 #define __NR_ssetmask           69
 #define __NR_setreuid           70
 #define __NR_setregid           71
+#define __NR_swapon             72
+#define __NR_vfork              73
+#define __NR_mmap               74
+#define __NR_munmap             75
+#define __NR_vtimes             76
+#define __NR_nanosleep          77
+#define __NR_clock_gettime      78
+#define __NR_sched_setscheduler 79
+#define __NR_sched_getscheduler 80
+#define __NR_sched_setparam     81
+#define __NR_sched_getparam     82
+#define __NR_sched_trace        83
 
 #define _syscall0(type, name)                 \
     type name(void)                           \
@@ -249,5 +261,7 @@ int dup2(int oldfd, int newfd);
 int getppid(void);
 pid_t getpgrp(void);
 pid_t setsid(void);
+int swapon(const char *specialfile);
+int vfork(void);
 
 #endif
@@ -34,6 +34,7 @@ static inline _syscall0(int, fork)
 #include <linux/tty.h>
 #include <linux/sched.h>
 #include <linux/head.h>
+#include <linux/hrtimer.h>
 #include <asm/system.h>
 #include <asm/io.h>
 
@@ -60,8 +61,9 @@ extern void chr_dev_init(void);
 extern void hd_init(void);
 /* 软驱初始化程序(kernel/blk_drv/floppy.c). */
 extern void floppy_init(void);
-/* 内存管理初始化(mm/memory.c). */
-extern void mem_init(long start, long end);
+/* 内存管理初始化(mm/memory.c)，原型在include/linux/mm.h中. */
+/* 建立16MB以上内存的内核页表和内存映射字节图(mm/memory.c). */
+extern long paging_init(long start, long end);
 /* 虚拟盘初始化(kernel/blk_drv/ramdisk.c). */
 extern long rd_init(long mem_start, int length);
 /* 建立内核时间(秒). */
@@ -73,6 +75,8 @@ extern long startup_time;
  * 以下这些数据是由setup.s程序在引导时间设置的.
  */
 #define EXT_MEM_K (*(unsigned short *)0x90002)
+#define E820_NR (*(unsigned short *)0x900A0)
+#define E820_MAP ((struct e820entry *)0x900A4)
 #define DRIVE_INFO (*(struct drive_info *)0x90080)
 #define ORIG_ROOT_DEV (*(unsigned short *)0x901FC)
 
@@ -122,6 +126,9 @@ static void time_init(void)
 
     time.tm_mon--;
     startup_time = kernel_mktime(&time);
+
+    /* 校准TSC，准备高精度定时器(kernel/hrtimer.c). */
+    hrtimer_init();
 }
 
 /* 机器具有的内存(字节数). */
@@ -136,6 +143,39 @@ struct drive_info
     char dummy[32];
 } drive_info;
 
+/**
+ * 取E820内存映射表中可用内存区域的最高结束地址(4Gb以上的部分不计).
+ * 注意：表在0x900A0开始处，会被缓冲区覆盖，所以必须在buffer_init()之前使用.
+ */
+static long e820_memory_end(struct e820entry *map, int nr)
+{
+    unsigned long end, max = 0;
+
+    for (; nr-- > 0; map++)
+    {
+        if (map->type != E820_RAM || map->addr_hi)
+            continue;
+
+        end = map->addr + map->size;
+
+        if (map->size_hi || end < map->addr)
+            end = 0xfffff000;
+
+        if (end > max)
+            max = end;
+    }
+
+    /* 如果表中没有1Mb以上的内存(表有误)，则仍按1Mb计. */
+    if (max < (1 << 20))
+        max = 1 << 20;
+
+    /* 超过MAX_MEMORY的部分后面会被截掉，这里先限制一下以免成为负数. */
+    if (max > MAX_MEMORY)
+        max = MAX_MEMORY;
+
+    return max;
+}
+
 /**
  * 这里确实是void，并没错。在startup程序(head.s)中就是这样假设的.
  */
@@ -153,15 +193,32 @@ void main(void)
     /* 内存大小=1Mb字节 + 扩展内存(k)*1024字节. */
     memory_end = (1 << 20) + (EXT_MEM_K << 10);
 
+    /* 如果BIOS提供了E820内存映射表，则以其中最高的可用内存地址作为内存大小. */
+    if (E820_NR)
+        memory_end = e820_memory_end(E820_MAP, E820_NR);
+
     /* 忽略不到4Kb（1 页）的内存数. */
     memory_end &= 0xfffff000;
 
-    /* 如果内存超过16Mb，则按16Mb计. */
-    if (memory_end > 16 * 1024 * 1024)
-        memory_end = 16 * 1024 * 1024;
+    /* 如果内存超过内核能映射的上限(64Mb)，则按上限计. */
+    if (memory_end > MAX_MEMORY)
+        memory_end = MAX_MEMORY;
+
+    /**
+     * 查找其它处理器(kernel/smp.c)，必须在缓冲区覆盖1MB以下内存之前。有多个处理器时
+     * 最后4Mb线性空间要用来映射本地APIC.
+     */
+    if (smp_scan() && memory_end > FIXMAP_START)
+        memory_end = FIXMAP_START;
 
-    /* 如果内存>12Mb，则设置缓冲区末端=4Mb. */
-    if (memory_end > 12 * 1024 * 1024)
+    /**
+     * 缓冲区和虚拟盘都位于16Mb以下(head.s已为这部分内存建立好页表)。
+     * 如果内存>32Mb，则设置缓冲区末端=8Mb.
+     */
+    if (memory_end > 32 * 1024 * 1024)
+        buffer_memory_end = 8 * 1024 * 1024;
+    /* 否则如果内存>12Mb，则设置缓冲区末端=4Mb. */
+    else if (memory_end > 12 * 1024 * 1024)
         buffer_memory_end = 4 * 1024 * 1024;
     /* 否则如果内存>6Mb，则设置缓冲区末端=2Mb. */
     else if (memory_end > 6 * 1024 * 1024)
@@ -177,8 +234,11 @@ void main(void)
     main_memory_start += rd_init(main_memory_start, RAMDISK * 1024);
 #endif
 
+    /* 按实际内存大小建立16Mb以上的内核页表和内存映射字节图，它们也占用主内存区. */
+    main_memory_start = paging_init(main_memory_start, memory_end);
+
     /* 以下是内核进行所有方面的初始化工作. */
-    mem_init(main_memory_start, memory_end);
+    mem_init(main_memory_start, memory_end, E820_MAP, E820_NR);
 
     /* 陷阱门(硬件中断向量)初始化。(kernel/traps.c). */
     trap_init();
@@ -210,6 +270,9 @@ void main(void)
     /* 所有初始化工作都做完了，开启中断. */
     sti();
 
+    /* 启动其它处理器，它们进入空闲循环等待分配给它们的任务(kernel/smp.c). */
+    smp_boot_cpus();
+
     /* 下面过程通过在堆栈中设置的参数，利用中断返回指令切换到任务0. */
     /* 移到用户模式。(include/asm/system.h). */
     move_to_user_mode();
@@ -225,7 +288,8 @@ void main(void)
      * 回就绪运行态，但任务 0（task0）是唯一的意外情况（参见'schedule()'），因为
      * 任务 0 在任何空闲时间里都会被激活（当没有其它任务在运行时），因此对于任务0
      * 'pause()'仅意味着我们返回来查看是否有其它任务可以运行，如果没有的话我们就回
-     * 到这里，一直循环执行'pause()'.
+     * 到这里，一直循环执行'pause()'。任务0的'pause()'还会顺便清零空闲页面备用
+     * (见mm/memory.c中的fill_zero_pool())，没有事情可做时则停机等待中断.
      */
     for (;;)
         pause();
@@ -36,8 +36,12 @@ no_error_code:
     mov %dx,%ds
     mov %dx,%es
     mov %dx,%fs
+    pushl %eax
+    call _lock_kernel       # see system_call.s
+    popl %eax
     call *%eax
     addl $8,%esp
+    call _unlock_kernel
     pop %fs
     pop %es
     pop %ds
@@ -114,8 +118,10 @@ error_code:
     mov %ax,%ds
     mov %ax,%es
     mov %ax,%fs
+    call _lock_kernel
     call *%ebx
     addl $8,%esp
+    call _unlock_kernel
     pop %fs
     pop %es
     pop %ds
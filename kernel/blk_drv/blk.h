@@ -30,6 +30,7 @@ struct request
     char *buffer;
     struct task_struct *waiting;
     struct buffer_head *bh;
+    int *uptodate; /* 没有缓冲区头时(ll_rw_page())在这里写入结果 */
     struct request *next;
 };
 
@@ -51,7 +52,7 @@ struct blk_dev_struct
 
 extern struct blk_dev_struct blk_dev[NR_BLK_DEV];
 extern struct request request[NR_REQUEST];
-extern struct task_struct *wait_for_request;
+extern struct wait_queue *wait_for_request;
 
 #ifdef MAJOR_NR
 
@@ -116,14 +117,28 @@ extern inline void end_request(int uptodate)
         CURRENT->bh->b_uptodate = uptodate;
         unlock_buffer(CURRENT->bh);
     }
+    if (CURRENT->uptodate)
+        *CURRENT->uptodate = uptodate;
     if (!uptodate)
     {
         printk(DEVICE_NAME " I/O error\n\r");
-        printk("dev %04x, block %d\n\r", CURRENT->dev,
-               CURRENT->bh->b_blocknr);
+        if (CURRENT->bh)
+            printk("dev %04x, block %d\n\r", CURRENT->dev,
+                   CURRENT->bh->b_blocknr);
+        else
+            printk("dev %04x, sector %d\n\r", CURRENT->dev,
+                   CURRENT->sector);
     }
-    wake_up(&CURRENT->waiting);
-    wake_up(&wait_for_request);
+    if (CURRENT->waiting)
+        wake_up_process(CURRENT->waiting);
+    /*
+     * 空出的请求项在前2/3时读写都能用，只唤醒一个等待者；在后1/3时只有读
+     * (和页面交换)能用，唤醒全部等待者，以免只唤醒了一个写请求而读请求没醒.
+     */
+    if (CURRENT < request + (NR_REQUEST * 2) / 3)
+        wake_up(&wait_for_request);
+    else
+        wake_up_all(&wait_for_request);
     CURRENT->dev = -1;
     CURRENT = CURRENT->next;
 }
@@ -131,8 +131,34 @@ static unsigned char track = 0;
 static unsigned char seek_track = 0;
 static unsigned char current_track = 255;
 static unsigned char command = 0;
+
+/* 软驱定时器的处理函数：data是要调用的函数. */
+static void fd_timer_fn(unsigned long data)
+{
+    ((void (*)(void))data)();
+}
+
+static struct timer_list fd_timer = {NULL, NULL, 0, 0, fd_timer_fn};
+
+/**
+ * ticks个滴答后调用函数fn，ticks<=0则立刻调用(关中断)。软驱同一时间只有一个
+ * 这样的定时操作，所以共用一个定时器.
+ */
+static void fd_add_timer(long ticks, void (*fn)(void))
+{
+    if (ticks <= 0)
+    {
+        cli();
+        fn();
+        sti();
+        return;
+    }
+
+    fd_timer.data = (unsigned long)fn;
+    mod_timer(&fd_timer, jiffies + ticks);
+}
 unsigned char selected = 0;
-struct task_struct *wait_on_floppy_select = NULL;
+struct wait_queue *wait_on_floppy_select = NULL;
 
 /**
  * 释放(取消选定的)软盘(软驱)。
@@ -649,7 +675,7 @@ static void floppy_on_interrupt(void)
     /**
      * 如果当前驱动器号与数字输出寄存器 DOR 中的不同，则重新设置 DOR 为当前驱动器
      * current_drive。
-     * 定时延迟2个滴答时间，然后调用软盘读写传输函数transfer()。否则直接调用软盘
+     * 定时延迟20ms(HZ=100时2个滴答)，然后调用软盘读写传输函数transfer()。否则直接调用软盘
      * 读写传输函数.
      */
     if (current_drive != (current_DOR & 3))
@@ -661,7 +687,7 @@ static void floppy_on_interrupt(void)
         outb(current_DOR, FD_DOR);
 
         /* 添加定时器并执行传输函数. */
-        add_timer(2, &transfer);
+        fd_add_timer((HZ + 49) / 50, &transfer);
     }
     else
         /* 执行软盘读写传输函数. */
@@ -749,7 +775,7 @@ void do_fd_request(void)
      * 添加定时器，用于指定驱动器到能正常运行所需延迟的时间(滴答数)，当定时时间到时就调用
      * 函数floppy_on_interrupt().
      */
-    add_timer(ticks_to_floppy_on(current_drive), &floppy_on_interrupt);
+    fd_add_timer(ticks_to_floppy_on(current_drive), &floppy_on_interrupt);
 }
 
 /**
@@ -22,7 +22,7 @@ struct request request[NR_REQUEST];
 /*
  * 是用于请求数组没有空闲项时的临时等待处.
  */
-struct task_struct *wait_for_request = NULL;
+struct wait_queue *wait_for_request = NULL;
 
 /* blk_dev_struct is:
  *	do_request-address
@@ -48,9 +48,9 @@ static inline void lock_buffer(struct buffer_head *bh)
     /* 清中断. */
     cli();
 
-    /* 如果缓冲区已被锁定，则睡眠，直到缓冲区解锁. */
+    /* 如果缓冲区已被锁定，则睡眠(独占地等待)，直到缓冲区解锁. */
     while (bh->b_lock)
-        sleep_on(&bh->b_wait);
+        sleep_on_exclusive(&bh->b_wait);
 
     /* 立刻锁定该缓冲区. */
     bh->b_lock = 1;
@@ -206,8 +206,8 @@ repeat:
             return;
         }
 
-        /* 否则让本次请求睡眠，过会再查看请求队列. */
-        sleep_on(&wait_for_request);
+        /* 否则让本次请求睡眠，过会再查看请求队列。每空出一项只唤醒一个等待者. */
+        sleep_on_exclusive(&wait_for_request);
         goto repeat;
     }
 
@@ -220,12 +220,70 @@ repeat:
     req->buffer = bh->b_data;           /* 数据缓冲区. */
     req->waiting = NULL;                /* 任务等待操作执行完成的地方. */
     req->bh = bh;                       /* 缓冲区头指针. */
+    req->uptodate = NULL;
     req->next = NULL;                   /* 指向下一请求项. */
 
     /* 将请求项加入队列中(blk_dev[major],req). */
     add_request(major + blk_dev, req);
 }
 
+/**
+ * ll_rw_page - 低层读写页面函数，用于页面交换。
+ * 读写设备上第page页(8个扇区)到内存buffer处。请求项中没有缓冲区头(bh=NULL)，
+ * 当前任务在请求项的waiting上睡眠，直到操作完成。交换操作很重要，所以与读请求
+ * 一样可以使用整个请求队列。操作成功返回1，出错返回0.
+ */
+int ll_rw_page(int rw, int dev, int page, char *buffer)
+{
+    struct request *req;
+    unsigned int major = MAJOR(dev);
+    int uptodate = 0;
+
+    if (major >= NR_BLK_DEV || !(blk_dev[major].request_fn))
+    {
+        printk("Trying to read nonexistent block-device\n\r");
+        return 0;
+    }
+
+    if (rw != READ && rw != WRITE)
+        panic("Bad block dev command, must be R/W");
+
+repeat:
+    req = request + NR_REQUEST;
+
+    while (--req >= request)
+        if (req->dev < 0)
+            break;
+
+    if (req < request)
+    {
+        sleep_on_exclusive(&wait_for_request);
+        goto repeat;
+    }
+
+    /* 填写请求项。1页=8扇区. */
+    req->dev = dev;
+    req->cmd = rw;
+    req->errors = 0;
+    req->sector = page << 3;
+    req->nr_sectors = 8;
+    req->buffer = buffer;
+    req->waiting = current;
+    req->bh = NULL;
+    req->uptodate = &uptodate;
+    req->next = NULL;
+
+    /**
+     * 先置为不可中断睡眠状态再加入请求，这样即使请求立刻完成也不会丢失唤醒。
+     * 请求完成(end_request())之前uptodate不会被写入.
+     */
+    current->state = TASK_UNINTERRUPTIBLE;
+    add_request(major + blk_dev, req);
+    schedule();
+
+    return uptodate;
+}
+
 /**
  * ll_rw_block - 低层读写数据块函数。
  * 该函数主要是在fs/buffer.c中被调用。实际的读写操作是由设备的request_fn()函数完成.
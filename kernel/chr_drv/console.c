@@ -957,13 +957,14 @@ void con_init(void)
  * sysbeepstop - 停止蜂鸣.
  * 复位8255A PB端口的位1和位0.
  */
-void sysbeepstop(void)
+static void sysbeepstop(unsigned long unused)
 {
     /* disable counter 2 */
     outb(inb_p(0x61) & 0xFC, 0x61);
 }
 
-int beepcount = 0;
+/* 蜂鸣定时器，到期时停止蜂鸣. */
+static struct timer_list beep_timer = {NULL, NULL, 0, 0, sysbeepstop};
 
 /**
  * sysbeep - 开通蜂鸣.
@@ -985,5 +986,5 @@ static void sysbeep(void)
     outb(0x06, 0x42);
 
     /* 蜂鸣时间为1/8秒. */
-    beepcount = HZ / 8;
+    mod_timer(&beep_timer, jiffies + HZ / 8);
 }
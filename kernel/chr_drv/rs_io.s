@@ -48,6 +48,7 @@ rs_int:
     pop %ds
     pushl $0x10
     pop %es
+    call _lock_kernel   /* see kernel/system_call.s */
     movl 24(%esp),%edx
     movl (%edx),%edx
     movl rs_addr(%edx),%edx
@@ -67,6 +68,7 @@ rep_int:
     jmp rep_int
 end:    movb $0x20,%al
     outb %al,$0x20      /* EOI */
+    call _unlock_kernel
     pop %ds
     pop %es
     popl %eax
@@ -146,7 +146,10 @@ void tty_intr(struct tty_struct *tty, int mask)
     for (i = 0; i < NR_TASKS; i++)
         /* 如果该项任务指针不为空，并且其组号等于tty组号，则设置该任务指定的信号mask. */
         if (task[i] && task[i]->pgrp == tty->pgrp)
+        {
             task[i]->signal |= mask;
+            signal_wake_up(task[i]);
+        }
 }
 
 /**
@@ -407,7 +410,7 @@ int tty_read(unsigned channel, char *buf, int nr)
     oldalarm = current->alarm;
 
     /* 并设置读操作超时定时值 time 和需要最少读取的字符个数 minimum. */
-    time = 10L * tty->termios.c_cc[VTIME];
+    time = (HZ * (long)tty->termios.c_cc[VTIME]) / 10;
     minimum = tty->termios.c_cc[VMIN];
 
     /**
@@ -423,7 +426,7 @@ int tty_read(unsigned channel, char *buf, int nr)
          * 进程定时值为 time+当前系统时间，并置flag标志.
          */
         if (flag = (!oldalarm || time + jiffies < oldalarm))
-            current->alarm = time + jiffies;
+            set_alarm(current, time + jiffies);
     }
 
     /* 如果设置的最少读取字符数>欲读的字符数，则令其等于此次欲读取的字符数. */
@@ -488,9 +491,9 @@ int tty_read(unsigned channel, char *buf, int nr)
              * 进程定时值为time+当前系统时间，并置flag标志。否则让进程的定时值等于进程原定时值.
              */
             if (flag = (!oldalarm || time + jiffies < oldalarm))
-                current->alarm = time + jiffies;
+                set_alarm(current, time + jiffies);
             else
-                current->alarm = oldalarm;
+                set_alarm(current, oldalarm);
 
         /**
          * 如果规范模式标志置位，那么若没有读到1个字符则中断循环。否则若已读取数大于或等于
@@ -506,7 +509,7 @@ int tty_read(unsigned channel, char *buf, int nr)
     }
 
     /* 让进程的定时值等于进程原定时值. */
-    current->alarm = oldalarm;
+    set_alarm(current, oldalarm);
 
     /* 如果进程有信号并且没有读取任何字符，则返回出错号(超时). */
     if (current->signal && !(b - buf))
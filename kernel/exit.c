@@ -32,6 +32,7 @@ void release(struct task_struct *p)
         {
             /* 置空该任务项并释放相关内存页. */
             task[i] = NULL;
+            sched_exit(p);
             free_page((long)p);
 
             /* 重新调度. */
@@ -58,7 +59,10 @@ static inline int send_sig(long sig, struct task_struct *p, int priv)
      * 用于判断是否超级用户.
      */
     if (priv || (current->euid == p->euid) || suser())
+    {
         p->signal |= (1 << (sig - 1));
+        signal_wake_up(p);
+    }
     else
         return -EPERM;
 
@@ -77,7 +81,10 @@ static void kill_session(void)
     while (--p > &FIRST_TASK)
     {
         if (*p && (*p)->session == current->session)
+        {
             (*p)->signal |= 1 << (SIGHUP - 1);      /* 发送挂断进程信号. */
+            signal_wake_up(*p);
+        }
     }
 }
 
@@ -141,6 +148,7 @@ static void tell_father(int pid)
             if (task[i]->pid != pid)
                 continue;
             task[i]->signal |= (1 << (SIGCHLD - 1));
+            signal_wake_up(task[i]);
             return;
         }
 
@@ -160,9 +168,20 @@ int do_exit(long code)
 {
     int i;
 
-    /* 释放当前进程代码段和数据段所占的内存页(free_page_tables()在mm/memory.c). */
-    free_page_tables(get_base(current->ldt[1]), get_limit(0x0f));
-    free_page_tables(get_base(current->ldt[2]), get_limit(0x17));
+    /**
+     * 释放当前进程代码段和数据段所占的内存页(free_page_tables()在mm/memory.c)。
+     * vfork()的子进程用的是父进程的内存，不释放，只唤醒父进程.
+     * 文件映射区中修改过的共享页面要先写回文件.
+     */
+    exit_mmap(current);
+
+    if (current->vfork_parent)
+        vfork_release(current);
+    else
+    {
+        free_page_tables(get_base(current->ldt[1]), get_limit(0x0f));
+        free_page_tables(get_base(current->ldt[2]), get_limit(0x17));
+    }
 
     /**
      * 如果当前进程有子进程，就将子进程的father置为1(其父进程改为进程1)。
@@ -202,6 +221,9 @@ int do_exit(long code)
     if (current->leader)
         kill_session();
 
+    /* 任务结构不久就要释放，alarm定时器必须从定时器轮上取下. */
+    set_alarm(current, 0);
+
     /* 把当前进程置为僵死状态，并设置退出码. */
     current->state = TASK_ZOMBIE;
     current->exit_code = code;
@@ -17,6 +17,7 @@
 #include <asm/system.h>
 
 extern void write_verify(unsigned long address);
+extern void ret_from_fork(void);
 
 long last_pid = 0;
 
@@ -79,7 +80,7 @@ int copy_mem(int nr, struct task_struct *p)
     set_base(p->ldt[1], new_code_base);         /* 设置代码段描述符中基址域. */
     set_base(p->ldt[2], new_data_base);         /* 设置数据段描述符中基址域. */
 
-    /* 复制代码和数据段. */
+    /* 复制代码和数据段(页表在父子进程间共享，写时才复制). */
     if (copy_page_tables(old_data_base, new_data_base, data_limit))
     {
         /* 如果出错则释放申请的内存. */
@@ -95,8 +96,11 @@ int copy_mem(int nr, struct task_struct *p)
  * 它还整个地复制数据段.
  */
 
-/* 复制进程. */
-int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
+/**
+ * 复制进程。vfork不为0时(vfork()系统调用)，子进程不复制页表而直接借用父进程的地址空间，
+ * 父进程则不可中断地睡眠，直到子进程执行execve()或退出时调用vfork_release()把它唤醒.
+ */
+int copy_process(int nr, long vfork, long ebp, long edi, long esi, long gs, long none,
                  long ebx, long ecx, long edx,
                  long fs, long es, long ds,
                  long eip, long cs, long eflags, long esp, long ss)
@@ -104,6 +108,7 @@ int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
     struct task_struct *p;
     int i;
     struct file *f;
+    long *stack;
 
     /* 为新任务数据结构分配内存. */
     p = (struct task_struct *)get_free_page();
@@ -121,35 +126,45 @@ int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
     p->state    = TASK_UNINTERRUPTIBLE; /* 将新进程的状态先置为不可中断等待状态. */
     p->pid      = last_pid;             /* 新进程号。由前面调用find_empty_process()得到。 */
     p->father   = current->pid;         /* 设置父进程号. */
-    p->counter  = p->priority;
     p->signal   = 0;                    /* 信号位图置0. */
     p->alarm    = 0;
+    init_timer(&p->real_timer);
     p->leader   = 0;                    /* 进程的领导权是不能继承的. */
     p->utime    = p->stime = 0;         /* 初始化用户态时间和核心态时间. */
     p->cutime   = p->cstime = 0;        /* 初始化子进程用户态和核心态时间. */
     p->start_time = jiffies;            /* 当前滴答数时间. */
-    p->tss.back_link = 0;               /* 以下设置任务状态段TSS所需的数据. */
-    /* 堆栈指针(由于是给任务结构p分配了1页新内存，所以此时esp0正好指向该页顶端). */
-    p->tss.esp0 = PAGE_SIZE + (long)p;
-    p->tss.ss0  = 0x10;                 /* 堆栈段选择符(内核数据段). */
-    p->tss.eip  = eip;                  /* 指令代码指针. */
-    p->tss.eflags = eflags;             /* 标志寄存器. */
-    p->tss.eax  = 0;
-    p->tss.ecx  = ecx;
-    p->tss.edx  = edx;
-    p->tss.ebx  = ebx;
-    p->tss.esp  = esp;
-    p->tss.ebp  = ebp;
-    p->tss.esi  = esi;
-    p->tss.edi  = edi;
-    p->tss.es   = es & 0xffff;          /* 段寄存器仅16位有效. */
-    p->tss.cs   = cs & 0xffff;
-    p->tss.ss   = ss & 0xffff;
-    p->tss.ds   = ds & 0xffff;
-    p->tss.fs   = fs & 0xffff;
+    p->min_flt = p->maj_flt = p->cow_flt = 0;
+    p->nvcsw = p->nivcsw = 0;
+    p->vfork_parent = NULL;
+
+    /**
+     * 在新任务的内核堆栈(任务结构所在页的顶端)上做出它从fork()系统调用返回时的现场：
+     * 自底向上是iret用的用户态ss、esp、eflags、cs、eip，ret_from_sys_call弹出的
+     * ds、es、fs、edx、ecx、ebx、eax(子进程返回0)，以及ret_from_fork恢复的esi、edi、
+     * ebp。第一次切换到它时从ret_from_fork开始执行(见switch_to()).
+     */
+    stack = (long *)(PAGE_SIZE + (long)p);
+    *--stack = ss & 0xffff;             /* 段寄存器仅16位有效. */
+    *--stack = esp;
+    *--stack = eflags;
+    *--stack = cs & 0xffff;
+    *--stack = eip;
+    *--stack = ds & 0xffff;
+    *--stack = es & 0xffff;
+    *--stack = fs & 0xffff;
+    *--stack = edx;
+    *--stack = ecx;
+    *--stack = ebx;
+    *--stack = 0;
+    *--stack = esi;
+    *--stack = edi;
+    *--stack = ebp;
+
+    p->tss.esp0 = PAGE_SIZE + (long)p;  /* 内核堆栈底，切换时写入处理器的TSS. */
+    p->tss.esp  = (long)stack;
+    p->tss.eip  = (long)ret_from_fork;
+    p->tss.fs   = 0x17;                 /* 内核中fs指向用户数据段. */
     p->tss.gs   = gs & 0xffff;
-    p->tss.ldt  = _LDT(nr);             /* 该新任务nr的局部描述符表选择符(LDT的描述符在GDT中). */
-    p->tss.trace_bitmap = 0x80000000;
 
     /* 如果当前任务使用了协处理器，就保存其上下文. */
     if (last_task_used_math == current)
@@ -160,8 +175,14 @@ int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
      * 则复位任务数组中相应项并释放为该新任务分配的内存页.
      * 
      * 返回不为0表示出错.
+     * vfork()的子进程与父进程的段基址相同(LDT已随任务结构复制)，不需要复制任何东西.
      */
-    if (copy_mem(nr, p))
+    if (vfork)
+    {
+        p->vfork_parent = current;
+        p->rss = 0;                     /* 驻留页面都算在父进程上. */
+    }
+    else if (copy_mem(nr, p))
     {
         task[nr] = NULL;
         free_page((long)p);
@@ -183,20 +204,43 @@ int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
     if (current->executable)
         current->executable->i_count++;
 
-    /**
-     * 在GDT中设置新任务的TSS和LDT描述符项，数据从task结构中取。
-     * 在任务切换时，任务寄存器tr由CPU自动加载.
-     */
-    set_tss_desc(gdt + (nr << 1) + FIRST_TSS_ENTRY, &(p->tss));
-    set_ldt_desc(gdt + (nr << 1) + FIRST_LDT_ENTRY, &(p->ldt));
+    /* 子进程继承父进程的文件映射区. */
+    for (i = 0; i < NR_MMAP; i++)
+        if (p->mmap[i].end)
+            p->mmap[i].inode->i_count++;
 
     /* 最后再将新任务设置成可运行状态，以防万一. */
-    p->state = TASK_RUNNING;
+    sched_fork(p);
+    wake_up_process(p);
+
+    /* 在子进程归还地址空间之前，父进程不能运行(也不能被杀死而释放内存). */
+    while (p->vfork_parent == current)
+    {
+        current->state = TASK_UNINTERRUPTIBLE;
+        schedule();
+    }
 
     /* 返回新进程号(与任务号是不同的). */
     return last_pid;
 }
 
+/**
+ * vfork()产生的子进程p执行execve()或退出时调用，把借用的地址空间还给父进程，
+ * 并唤醒在copy_process()中等待的父进程.
+ */
+void vfork_release(struct task_struct *p)
+{
+    struct task_struct *parent;
+
+    if (!(parent = p->vfork_parent))
+        return;
+
+    p->vfork_parent = NULL;
+
+    if (parent->state == TASK_UNINTERRUPTIBLE)
+        wake_up_process(parent);
+}
+
 /**
  * 为新进程取得不重复的进程号last_pid，并返回在任务数组中的任务号(数组index).
  */
@@ -0,0 +1,389 @@
+/*
+ *  linux/kernel/hrtimer.c
+ */
+
+/**
+ * 高精度时间和定时器.
+ *
+ * 时间取自CPU的时间戳计数器(TSC)：time_init()中用8253的计数器2定时10ms，数出这段
+ * 时间内TSC的增量，算出每个时钟周期的纳秒数(左移24位的定点数tsc_mult)。之后
+ * ktime_get()读TSC就能得到开机以来的纳秒数。没有TSC的CPU(386和早期的486)只能按
+ * jiffies计时，精度为一个滴答.
+ *
+ * 高精度定时器按到期时间排成有序链表。有定时器时打开CMOS实时钟(RTC)的周期中断
+ * (8192Hz，约122us一次)，每次中断处理所有到期的定时器，链表空了就关掉周期中断，
+ * 所以不影响时钟滴答(和空闲时停止滴答)。比RTC中断间隔还短的睡眠直接在TSC上忙等.
+ * 没有TSC时，定时器在时钟中断(do_timer())中处理.
+ */
+
+#include <errno.h>
+#include <time.h>
+
+#include <linux/sched.h>
+#include <linux/head.h>
+#include <linux/kernel.h>
+#include <linux/hrtimer.h>
+#include <asm/system.h>
+#include <asm/io.h>
+#include <asm/segment.h>
+
+#define _S(nr)                  (1 << ((nr)-1))
+#define _BLOCKABLE              (~(_S(SIGKILL) | _S(SIGSTOP)))
+
+/**
+ * n = n / base，返回余数。n是64位的，base是32位的。内核不链接libgcc，不能直接
+ * 使用64位除法.
+ */
+#define do_div(n, base) ({                                              \
+    unsigned long __upper, __low, __high, __mod;                        \
+    __asm__("" : "=a"(__low), "=d"(__high) : "A"(n));                   \
+    __upper = __high;                                                   \
+    if (__high)                                                         \
+    {                                                                   \
+        __upper = __high % (base);                                      \
+        __high = __high / (base);                                       \
+    }                                                                   \
+    __asm__("divl %2" : "=a"(__low), "=d"(__mod)                        \
+                      : "rm"(base), "0"(__low), "1"(__upper));          \
+    __asm__("" : "=A"(n) : "a"(__low), "d"(__high));                    \
+    __mod;                                                              \
+})
+
+/* 校准TSC用的时间：8253计数器2计数11932次(1.193182MHz下约10ms). */
+#define CALIBRATE_LATCH         11932
+#define CALIBRATE_NSEC          10000000
+
+/* 比RTC周期中断间隔(1/8192秒)还短的睡眠直接忙等. */
+#define HRTIMER_SPIN_NSEC       122070
+
+/* RTC周期中断处理程序(kernel/system_call.s). */
+extern int rtc_interrupt(void);
+
+/* TSC频率(kHz)，0表示没有TSC或校准失败. */
+unsigned long tsc_khz = 0;
+/* 每个时钟周期的纳秒数，左移24位. */
+static unsigned long tsc_mult = 0;
+/* 校准完成时的TSC值，ktime_get()从这里开始计时. */
+static unsigned long long tsc_base = 0;
+
+/* 按到期时间排序的定时器链表，以及RTC周期中断是否已打开. */
+static struct hrtimer *hrtimer_head = NULL;
+static int rtc_pie_on = 0;
+
+static unsigned char rtc_read(unsigned char reg)
+{
+    outb_p(0x80 | reg, 0x70);
+    return inb_p(0x71);
+}
+
+static void rtc_write(unsigned char reg, unsigned char val)
+{
+    outb_p(0x80 | reg, 0x70);
+    outb_p(val, 0x71);
+}
+
+/* 打开或关闭RTC周期中断(寄存器B的位6). */
+static void rtc_set_pie(int on)
+{
+    unsigned char b = rtc_read(0x0B);
+
+    rtc_write(0x0B, on ? (b | 0x40) : (b & ~0x40));
+    rtc_pie_on = on;
+}
+
+/**
+ * 用8253的计数器2校准TSC。计数器2的门控由0x61端口的位0控制，方式0计数到0时
+ * 输出(0x61端口的位5)变高.
+ */
+static void calibrate_tsc(void)
+{
+    unsigned long startlow, starthigh, endlow, endhigh;
+    unsigned long cycles, count, rem;
+    unsigned long long n = (unsigned long long)CALIBRATE_NSEC << 24;
+
+    /* 打开计数器2的门控，关闭扬声器. */
+    outb((inb(0x61) & ~0x02) | 0x01, 0x61);
+
+    outb(0xb0, 0x43);                       /* binary, mode 0, LSB/MSB, ch 2 */
+    outb(CALIBRATE_LATCH & 0xff, 0x42);
+    outb(CALIBRATE_LATCH >> 8, 0x42);
+
+    rdtsc(startlow, starthigh);
+    count = 0;
+
+    do
+    {
+        count++;
+    } while (!(inb(0x61) & 0x20));
+
+    rdtsc(endlow, endhigh);
+
+    /* 10ms内TSC的增量不会超过32位. */
+    cycles = endlow - startlow;
+
+    /* 循环一次就结束说明计数器不工作；CPU太慢则tsc_mult会溢出. */
+    if (count <= 1 || cycles <= (unsigned long)(n >> 32))
+    {
+        printk("TSC calibration failed\n\r");
+        return;
+    }
+
+    __asm__("divl %2"
+            : "=a"(tsc_mult), "=d"(rem)
+            : "rm"(cycles), "0"((unsigned long)n), "1"((unsigned long)(n >> 32)));
+
+    tsc_khz = cycles / (CALIBRATE_NSEC / 1000000);
+    tsc_base = ((unsigned long long)endhigh << 32) | endlow;
+}
+
+/**
+ * 初始化：校准TSC，设置RTC周期中断的频率和中断门。由time_init()调用.
+ */
+void hrtimer_init(void)
+{
+    if (cpu_features & CPU_TSC)
+        calibrate_tsc();
+
+    if (!tsc_khz)
+    {
+        printk("No TSC: high-resolution timers use the timer tick\n\r");
+        return;
+    }
+
+    printk("TSC: %d kHz\n\r", tsc_khz);
+
+    /* 速率选择3：32768Hz >> 2 = 8192Hz。先关闭周期中断，并清除可能悬挂的中断. */
+    rtc_write(0x0A, (rtc_read(0x0A) & 0xf0) | 3);
+    rtc_set_pie(0);
+    rtc_read(0x0C);
+
+    /* RTC中断是IRQ8(从片的IRQ0)，中断号0x28. */
+    set_intr_gate(0x28, &rtc_interrupt);
+    outb(inb_p(0xA1) & ~0x01, 0xA1);
+}
+
+/**
+ * 返回开机(准确地说是TSC校准完成)以来的纳秒数.
+ */
+unsigned long long ktime_get(void)
+{
+    unsigned long low, high;
+    unsigned long long delta;
+
+    if (!tsc_khz)
+        return (unsigned long long)(unsigned long)jiffies * (NSEC_PER_SEC / HZ);
+
+    rdtsc(low, high);
+    delta = (((unsigned long long)high << 32) | low) - tsc_base;
+
+    /* delta * tsc_mult >> 24，分高低32位两次相乘，以免溢出. */
+    return (((delta >> 32) * tsc_mult) << 8) + (((delta & 0xffffffff) * tsc_mult) >> 24);
+}
+
+/* 把定时器从链表中取下. */
+static void detach_hrtimer(struct hrtimer *timer)
+{
+    if (*timer->pprev = timer->next)
+        timer->next->pprev = timer->pprev;
+
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+/**
+ * 启动定时器，到期时刻为expires(ktime_get()的纳秒值)。定时器已经挂上则重新设置.
+ * 可以在中断处理程序中调用.
+ */
+void hrtimer_start(struct hrtimer *timer, unsigned long long expires)
+{
+    struct hrtimer **p;
+    unsigned long flags;
+
+    save_flags(flags);
+    cli();
+
+    if (hrtimer_pending(timer))
+        detach_hrtimer(timer);
+
+    timer->expires = expires;
+
+    /* 按到期时间插入，到期时间相同的按先后顺序. */
+    for (p = &hrtimer_head; *p && (*p)->expires <= expires; p = &(*p)->next)
+        ;
+
+    if (timer->next = *p)
+        (*p)->pprev = &timer->next;
+
+    *p = timer;
+    timer->pprev = p;
+
+    if (tsc_khz && !rtc_pie_on)
+        rtc_set_pie(1);
+
+    restore_flags(flags);
+}
+
+/**
+ * 取消定时器。定时器原来挂着则返回1，已经到期返回0.
+ */
+int hrtimer_cancel(struct hrtimer *timer)
+{
+    unsigned long flags;
+    int ret = 0;
+
+    save_flags(flags);
+    cli();
+
+    if (hrtimer_pending(timer))
+    {
+        detach_hrtimer(timer);
+        ret = 1;
+    }
+
+    restore_flags(flags);
+
+    return ret;
+}
+
+/**
+ * 处理所有到期的定时器，返回处理的个数。在RTC中断和时钟中断中调用(中断已关闭).
+ */
+int run_hrtimers(void)
+{
+    struct hrtimer *timer;
+    unsigned long long now;
+    int n = 0;
+
+    if (!hrtimer_head)
+        return 0;
+
+    now = ktime_get();
+
+    while ((timer = hrtimer_head) && timer->expires <= now)
+    {
+        detach_hrtimer(timer);
+        timer->function(timer->data);
+        n++;
+    }
+
+    if (!hrtimer_head && rtc_pie_on)
+        rtc_set_pie(0);
+
+    return n;
+}
+
+/**
+ * 没有TSC时定时器靠时钟滴答处理，有定时器就不能停止滴答(见kernel/sched.c).
+ */
+int hrtimer_needs_tick(void)
+{
+    return !tsc_khz && hrtimer_head;
+}
+
+/**
+ * RTC周期中断C处理程序，在kernel/system_call.s中的_rtc_interrupt被调用。
+ * 参数cpl是被中断代码的特权级。唤醒了任务且中断的是用户程序则重新调度，让到期的
+ * 睡眠者及时运行.
+ */
+void do_rtc_interrupt(long cpl)
+{
+    /* 读寄存器C，应答RTC中断. */
+    rtc_read(0x0C);
+
+    if (run_hrtimers() && cpl)
+        schedule();
+}
+
+/* nanosleep()的定时器到期：唤醒睡眠的任务. */
+static void hrtimer_wakeup(unsigned long data)
+{
+    wake_up_process((struct task_struct *)data);
+}
+
+/* 把纳秒数ns换算成timespec结构，秒数再加上sec，存到用户空间tp处. */
+static void put_timespec(unsigned long long ns, long sec, struct timespec *tp)
+{
+    unsigned long nsec;
+
+    nsec = do_div(ns, NSEC_PER_SEC);
+    put_fs_long((unsigned long)ns + sec, (unsigned long *)&tp->tv_sec);
+    put_fs_long(nsec, (unsigned long *)&tp->tv_nsec);
+}
+
+/**
+ * 系统调用：睡眠req指定的时间(纳秒精度)。被信号中断则返回-EINTR，rem不为NULL时
+ * 在rem中返回剩余的时间.
+ */
+int sys_nanosleep(struct timespec *req, struct timespec *rem)
+{
+    struct hrtimer timer;
+    unsigned long long expires, now;
+    long sec, nsec;
+
+    sec = get_fs_long((unsigned long *)&req->tv_sec);
+    nsec = get_fs_long((unsigned long *)&req->tv_nsec);
+
+    if (sec < 0 || nsec < 0 || nsec >= NSEC_PER_SEC)
+        return -EINVAL;
+
+    now = ktime_get();
+    expires = now + (unsigned long long)sec * NSEC_PER_SEC + nsec;
+
+    /* 很短的睡眠不值得切换任务，直接忙等. */
+    if (tsc_khz && expires - now <= HRTIMER_SPIN_NSEC)
+    {
+        while (ktime_get() < expires)
+            ;
+
+        return 0;
+    }
+
+    init_hrtimer(&timer);
+    timer.data = (unsigned long)current;
+    timer.function = hrtimer_wakeup;
+    current->state = TASK_INTERRUPTIBLE;
+    hrtimer_start(&timer, expires);
+
+    /* 先置睡眠状态再检查，定时器在schedule()之前到期也不会丢失唤醒. */
+    while (hrtimer_pending(&timer) && !(current->signal & ~(_BLOCKABLE & current->blocked)))
+    {
+        schedule();
+        current->state = TASK_INTERRUPTIBLE;
+    }
+
+    current->state = TASK_RUNNING;
+
+    /* 定时器已经到期，睡够了. */
+    if (!hrtimer_cancel(&timer))
+        return 0;
+
+    if (rem)
+    {
+        verify_area(rem, sizeof *rem);
+        now = ktime_get();
+        put_timespec((expires > now) ? (expires - now) : 0, 0, rem);
+    }
+
+    return -EINTR;
+}
+
+/**
+ * 系统调用：取时钟which的当前时间，纳秒精度。CLOCK_MONOTONIC是开机以来的时间，
+ * CLOCK_REALTIME是从1970年1月1日0时起的时间(与time()一致，随stime()改变).
+ */
+int sys_clock_gettime(int which, struct timespec *tp)
+{
+    long sec;
+
+    if (which == CLOCK_REALTIME)
+        sec = startup_time;
+    else if (which == CLOCK_MONOTONIC)
+        sec = 0;
+    else
+        return -EINVAL;
+
+    verify_area(tp, sizeof *tp);
+    put_timespec(ktime_get(), sec, tp);
+
+    return 0;
+}
@@ -61,5 +61,8 @@ void math_error(void)
 
     /* 如果上个任务使用过协处理器，则向上个任务发送协处理器异常信号. */
     if (last_task_used_math)
+    {
         last_task_used_math->signal |= 1 << (SIGFPE - 1);
+        signal_wake_up(last_task_used_math);
+    }
 }
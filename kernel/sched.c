@@ -13,11 +13,14 @@
 #include <linux/kernel.h>
 #include <linux/sys.h>
 #include <linux/fdreg.h>
+#include <linux/hrtimer.h>
 #include <asm/system.h>
 #include <asm/io.h>
 #include <asm/segment.h>
 
 #include <signal.h>
+#include <errno.h>
+#include <sys/sched_trace.h>
 
 /**
  * 取信号nr在信号位图中对应位的二进制数值。信号编号1-32.
@@ -57,9 +60,17 @@ void show_stat(void)
             show_task(i, task[i]);
 }
 
-/* 定义每个时间片的滴答数? */
+/* 8253定时器每个滴答的计数值(输入时钟1.193180MHz). */
 #define LATCH                   (1193180 / HZ)
 
+/* 8253计数器0设为周期方式(方式3)，每个滴答产生一次时钟中断. */
+static void pit_periodic(void)
+{
+    outb_p(0x36, 0x43);         /* binary, mode 3, LSB/MSB, ch 0 */
+    outb_p(LATCH & 0xff, 0x40); /* LSB,定时值低字节. */
+    outb(LATCH >> 8, 0x40);     /* MSB,定时值高字节. */
+}
+
 /* 没有任何地方定义和引用该函数. */
 extern void mem_use(void);
 
@@ -88,10 +99,14 @@ static union task_union init_task = {
 long volatile jiffies = 0;
 /* 开机时间。从 1970:0:0:0 开始计时的秒数. */
 long startup_time = 0;
-/* 当前任务指针(初始化为初始任务). */
-struct task_struct *current = &(init_task.task);
-/* 使用过协处理器任务的指针. */
-struct task_struct *last_task_used_math = NULL;
+/* 各处理器的当前任务指针(引导处理器初始化为初始任务). */
+struct task_struct *current_set[NR_CPUS] = {
+    &(init_task.task),
+};
+/* 各处理器上使用过协处理器任务的指针. */
+struct task_struct *math_owner[NR_CPUS] = {
+    NULL,
+};
 
 /* 定义任务指针数组. */
 struct task_struct *task[NR_TASKS] = {
@@ -148,85 +163,569 @@ void math_state_restore()
     }
 }
 
+/* 就绪队列的级数. */
+#define NR_PRIO                 32
+
 /**
- * 'schedule()'是调度函数。这是个很好的代码！没有任何理由对它进行修改，因为它可以在
- * 所有的环境下工作(比如能够对IO-边界处理很好的响应等)。只有一件事值得留意，那就是
- * 这里的信号处理代码。
+ * 就绪队列。每个可运行的任务(任务0和正在运行的当前任务除外)都在某一级队列中，
+ * 级数就是它的counter值(大于NR_PRIO-1的都放在最高级)，同级的任务按先进先出排队。
+ * 位图的第i位表示第i级队列不空，所以找counter最大的任务只要一条bsrl指令，与任务数
+ * 无关.
+ *
+ * 原来的做法是在所有可运行任务的counter都为0时，重新计算所有任务的counter =
+ * counter/2 + priority。这里用两组队列代替：时间片用完的任务放入expired组(counter
+ * 直接置为priority)，active组空了就交换两组，这就相当于一次重新计算，轮次sched_epoch
+ * 加1。睡眠中的任务错过的重新计算在它被唤醒时一次补上(最多补8次，之后counter已不再
+ * 变化)，所以睡眠较多的交互式任务仍会得到较大的counter.
+ */
+struct prio_array
+{
+    unsigned long bitmap;                   /* 第i位为1表示第i级队列不空. */
+    struct task_struct *queue[NR_PRIO];     /* 各级队列(循环双向链表)的表头. */
+};
+
+/**
+ * 每个处理器有一个就绪队列，放分配给该处理器的任务(task_struct.processor)，任务
+ * 在fork()时分配到任务最少的处理器上，以后不再迁移。idle是该处理器的空闲任务
+ * (引导处理器上是任务0)。实时任务(SCHED_FIFO/SCHED_RR)另放在rt组中，级数是它的
+ * 静态优先级rt_priority，不参与两组的交换；rt组不空时总是先从rt组中选.
+ */
+struct runqueue
+{
+    struct prio_array rt;
+    struct prio_array arrays[2];
+    struct prio_array *active, *expired;
+    long epoch;                             /* 重新计算counter的轮次. */
+    struct task_struct *idle;
+    int nr_tasks;                           /* 分配在该处理器上的任务数. */
+};
+
+static struct runqueue runqueues[NR_CPUS];
+
+#define this_rq()               (runqueues + smp_processor_id())
+#define task_rq(p)              (runqueues + (p)->processor)
+
+/* 就绪队列rq中有可运行的任务. */
+#define rq_busy(rq)             ((rq)->rt.bitmap || (rq)->active->bitmap || (rq)->expired->bitmap)
+
+#define rt_task(p)              ((p)->policy != SCHED_OTHER)
+
+/* 任务p在队列组中的级数：实时任务是静态优先级，其它任务是counter. */
+#define task_level(p)           (rt_task(p) ? (p)->rt_priority : \
+                                 ((p)->counter < NR_PRIO) ? (p)->counter : NR_PRIO - 1)
+
+/* 把任务p加到队列组array第level级队列的尾部. */
+static void enqueue_task(struct task_struct *p, struct prio_array *array)
+{
+    int level = task_level(p);
+    struct task_struct **head = array->queue + level;
+
+    if (!*head)
+    {
+        *head = p->run_next = p->run_prev = p;
+        array->bitmap |= 1 << level;
+    }
+    else
+    {
+        p->run_next = *head;
+        p->run_prev = (*head)->run_prev;
+        (*head)->run_prev->run_next = p;
+        (*head)->run_prev = p;
+    }
+
+    p->run_array = array;
+}
+
+/**
+ * 把任务p加到队列组array第level级队列的头部：被更高优先级任务抢占的FIFO任务要在
+ * 同级任务之前继续运行(POSIX)。队列是循环链表，加在尾部后把队头指向p即可.
+ */
+static void enqueue_task_head(struct task_struct *p, struct prio_array *array)
+{
+    enqueue_task(p, array);
+    array->queue[task_level(p)] = p;
+}
+
+/* 把任务p从它所在的队列中取下. */
+static void dequeue_task(struct task_struct *p)
+{
+    struct prio_array *array = p->run_array;
+    int level = task_level(p);
+    struct task_struct **head = array->queue + level;
+
+    if (p->run_next == p)
+    {
+        *head = NULL;
+        array->bitmap &= ~(1 << level);
+    }
+    else
+    {
+        p->run_prev->run_next = p->run_next;
+        p->run_next->run_prev = p->run_prev;
+
+        if (*head == p)
+            *head = p->run_next;
+    }
+
+    p->run_array = NULL;
+}
+
+/**
+ * 可运行的任务p进入它所属处理器的就绪队列：先补上它错过的counter重新计算，counter
+ * 不为0则放入active组，否则放入expired组(counter置为下一轮的值)。实时任务放入rt组，
+ * 时间片用完的RR任务重新得到priority个时间片，排在同级队列的尾部. 调用时中断已关闭.
+ */
+static void activate_task(struct task_struct *p)
+{
+    struct runqueue *rq = task_rq(p);
+    long n = rq->epoch - p->run_epoch;
+
+    if (rt_task(p))
+    {
+        if (p->counter <= 0)
+            p->counter = p->priority;
+
+        enqueue_task(p, &rq->rt);
+        return;
+    }
+
+    if (n > 8)
+        n = 8;
+
+    while (n-- > 0)
+        p->counter = (p->counter >> 1) + p->priority;
+
+    p->run_epoch = rq->epoch;
+
+    if (p->counter > 0)
+    {
+        enqueue_task(p, rq->active);
+        return;
+    }
+
+    p->counter = p->priority;
+    p->run_epoch = rq->epoch + 1;
+    enqueue_task(p, rq->expired);
+}
+
+/**
+ * 实时任务p刚进入就绪队列：如果它比所属处理器上正在运行的任务优先，就让那个任务
+ * 尽快重新调度(在返回用户态之前，见kernel/system_call.s). 调用时中断已关闭.
+ */
+static void check_preempt(struct task_struct *p)
+{
+    struct task_struct *curr = current_set[p->processor];
+
+    if (curr == task_rq(p)->idle || !rt_task(curr) || p->rt_priority > curr->rt_priority)
+        curr->need_resched = 1;
+}
+
+/**
+ * 置任务p为就绪状态并放入就绪队列。正在运行的任务不入队列，它在schedule()中处理。
+ * 可以在中断处理程序中调用.
+ */
+void wake_up_process(struct task_struct *p)
+{
+    struct runqueue *rq = task_rq(p);
+    unsigned long flags;
+
+    /* 已经退出的任务不能再运行. */
+    if (p->state == TASK_ZOMBIE)
+        return;
+
+    save_flags(flags);
+    cli();
+
+    /* 记下被唤醒的时刻，开始运行时计算唤醒延迟. */
+    if (p->state != TASK_RUNNING)
+        p->wake_time = trace_sched_event(SCHED_EV_RUNNING, p, current);
+
+    p->state = TASK_RUNNING;
+
+    if (p != current_set[p->processor] && p != rq->idle && !p->run_array)
+    {
+        activate_task(p);
+
+        if (rt_task(p))
+            check_preempt(p);
+
+        /* 任务所属的处理器正在空闲(停机)，用处理器间中断唤醒它. */
+        if (p->processor != smp_processor_id() && current_set[p->processor] == rq->idle)
+            smp_send_reschedule(p->processor);
+    }
+
+    restore_flags(flags);
+}
+
+/**
+ * 给任务p发信号后调用：若有未被阻塞的信号而任务处于可中断的睡眠状态，则唤醒它。
+ * (原来是由schedule()每次扫描所有任务来做的.)
+ */
+void signal_wake_up(struct task_struct *p)
+{
+    if ((p->signal & ~(_BLOCKABLE & p->blocked)) && p->state == TASK_INTERRUPTIBLE)
+        wake_up_process(p);
+}
+
+/**
+ * fork()时初始化新任务p的调度信息：分配到任务最少的处理器上，时间片为priority，
+ * 还不在就绪队列中。新任务第一次运行时从ret_from_fork开始，在那里才取得内核大锁.
+ */
+void sched_fork(struct task_struct *p)
+{
+    int cpu, best = 0;
+
+    for (cpu = 1; cpu < smp_num_cpus; cpu++)
+        if (runqueues[cpu].nr_tasks < runqueues[best].nr_tasks)
+            best = cpu;
+
+    p->processor = best;
+    runqueues[best].nr_tasks++;
+    p->counter = p->priority;
+    p->run_array = NULL;
+    p->run_epoch = runqueues[best].epoch;
+    p->need_resched = 0;
+    p->lock_depth = -1;
+}
+
+/**
+ * 任务p的任务结构被释放(exit.c中的release())时调用.
+ */
+void sched_exit(struct task_struct *p)
+{
+    task_rq(p)->nr_tasks--;
+}
+
+/**
+ * 处理器cpu启动时(kernel/smp.c)设置它的空闲任务，空闲任务同时是它的当前任务.
+ */
+void init_idle(struct task_struct *idle, int cpu)
+{
+    idle->processor = cpu;
+    runqueues[cpu].idle = idle;
+    current_set[cpu] = idle;
+}
+
+/**
+ * 每个处理器一个TSS，只用来在进入内核时提供内核堆栈(ss0:esp0)和屏蔽全部I/O端口；
+ * 一个LDT，里面是当前任务的代码段和数据段描述符(从任务结构的ldt中复制)。任务再多
+ * 也只占GDT中NR_CPUS对描述符.
+ */
+static struct tss_struct cpu_tss[NR_CPUS];
+static struct desc_struct cpu_ldt[NR_CPUS][3];
+
+/**
+ * 处理器cpu启动时调用(引导处理器在sched_init()中，其它处理器在smp_callin()中)：
+ * 设置并加载它的TSS和LDT。LDT先放任务0的描述符，使中断入口加载的0x17总是有效.
+ */
+void cpu_init(int cpu)
+{
+    struct tss_struct *tss = cpu_tss + cpu;
+
+    tss->esp0 = current_set[cpu]->tss.esp0;
+    tss->ss0 = 0x10;
+    tss->trace_bitmap = 0x80000000;     /* I/O位图在TSS界限之外. */
+    cpu_ldt[cpu][1] = init_task.task.ldt[1];
+    cpu_ldt[cpu][2] = init_task.task.ldt[2];
+
+    set_tss_desc(gdt + (cpu << 1) + FIRST_TSS_ENTRY, tss);
+    set_ldt_desc(gdt + (cpu << 1) + FIRST_LDT_ENTRY, cpu_ldt[cpu]);
+    ltr(cpu);
+    lldt(cpu);
+}
+
+/* LDT描述符有效(存在位)。其它处理器的空闲任务只在内核中运行，LDT是空的. */
+#define ldt_present(p)          ((p)->ldt[1].b & 0x8000)
+
+/**
+ * switch_to()(include/linux/sched.h)换到next的内核堆栈后调用，完成硬件任务切换
+ * 原来做的其余工作，但只做必要的：
+ * - 本处理器TSS的esp0改为next的内核堆栈；
+ * - next的段描述符与本处理器LDT中的不同时才复制(vfork()的子进程与父进程相同，空闲
+ *   任务不需要)，这时fs、gs即使选择符没变也要重新加载；
+ * - 每次都重新加载cr3，与硬件任务切换一样刷新TLB。所有任务共用页目录pg_dir，但
+ *   共享页表中的页面还能通过别的任务的线性地址访问，修改页表项时只刷新了其中一个
+ *   地址，其余的旧TLB项要靠这里清除。内核区的页面在支持PGE时是全局的，不受影响；
+ * - next不是最后使用协处理器的任务则置TS位，它用到协处理器时再恢复其状态.
+ */
+void __switch_to(struct task_struct *prev, struct task_struct *next)
+{
+    int cpu = next->processor;
+    struct desc_struct *ldt = cpu_ldt[cpu];
+    int reload = 0;
+
+    cpu_tss[cpu].esp0 = next->tss.esp0;
+
+    if (ldt_present(next) &&
+        (ldt[1].a != next->ldt[1].a || ldt[1].b != next->ldt[1].b ||
+         ldt[2].a != next->ldt[2].a || ldt[2].b != next->ldt[2].b))
+    {
+        ldt[1] = next->ldt[1];
+        ldt[2] = next->ldt[2];
+        reload = 1;
+    }
+
+    __asm__("movl %%fs,%0" : "=r"(prev->tss.fs));
+    __asm__("movl %%gs,%0" : "=r"(prev->tss.gs));
+
+    if (reload || next->tss.fs != prev->tss.fs)
+        __asm__("mov %0,%%fs" ::"r"(next->tss.fs));
+
+    if (reload || next->tss.gs != prev->tss.gs)
+        __asm__("mov %0,%%gs" ::"r"(next->tss.gs));
+
+    __asm__("movl %0,%%cr3" ::"r"(next->tss.cr3));
+
+    if (math_owner[cpu] == next)
+        __asm__("clts");
+    else
+        __asm__("movl %%cr0,%%eax ; orl $8,%%eax ; movl %%eax,%%cr0" ::: "ax");
+}
+
+/**
+ * 当前任务的LDT改变以后(fs/exec.c中的change_ldt())调用，更新本处理器的LDT.
+ */
+void load_ldt(void)
+{
+    struct desc_struct *ldt = cpu_ldt[current->processor];
+
+    ldt[1] = current->ldt[1];
+    ldt[2] = current->ldt[2];
+}
+
+/**
+ * 汇编程序(kernel/system_call.s)取当前任务指针用.
+ */
+struct task_struct *get_current(void)
+{
+    return current;
+}
+
+/**
+ * 'schedule()'是调度函数。有可运行的实时任务时选静态优先级最高的一个，否则从本处理
+ * 器的就绪队列中选择counter最大的可运行任务(counter相同时按先进先出)，与原来的算法
+ * 相同，但只需常数时间，见上面就绪队列的说明。
  *
  * 注意！！任务0是个闲置('idle')任务，只有当没有其它任务可以运行时才调用它。它不能被
- * 杀死，也不能睡眠。任务0中的状态信息'state'是从来不用的.
+ * 杀死，也不能睡眠。任务0中的状态信息'state'是从来不用的。其它处理器的空闲任务也一样.
  */
 void schedule(void)
 {
-    int i, next, c;
-    /* 任务结构指针的指针. */
-    struct task_struct **p;
+    struct runqueue *rq = this_rq();
+    struct task_struct *prev = current, *next;
+    struct prio_array *array;
+    unsigned long long now;
+    unsigned long flags;
+    int level, preempted;
+
+    save_flags(flags);
+    cli();
+    preempted = prev->need_resched;
+    prev->need_resched = 0;
 
-    /* 检测alarm(进程的报警定时值)，唤醒任何已得到信号的可中断任务. */
+    /**
+     * 当前任务在进入可中断睡眠之前已经收到了未被阻塞的信号，则不能睡眠。其它任务的
+     * 信号由发信号者唤醒(signal_wake_up()).
+     */
+    if (prev->state == TASK_INTERRUPTIBLE &&
+        (prev->signal & ~(_BLOCKABLE & prev->blocked)))
+    {
+        trace_sched_event(SCHED_EV_RUNNING, prev, prev);
+        prev->state = TASK_RUNNING;
+    }
 
-    /* 从任务数组中最后一个任务开始检测alarm. */
-    for (p = &LAST_TASK; p > &FIRST_TASK; --p)
-        /* 如果任务的alarm时间已经过期(alarm<jiffies),则在信号位图中置SIGALRM信号,然后清alarm. */
-        if (*p)
-        {
-            /* jiffies是系统从开机开始算起的滴答数(10ms/滴答)。定义在 sched.h. */
-            if ((*p)->alarm && (*p)->alarm < jiffies)
-            {
-                (*p)->signal |= (1 << (SIGALRM - 1));
-                (*p)->alarm = 0;
-            }
-
-            /**
-             * 如果信号位图中除被阻塞的信号外还有其它信号，并且任务处于可中断状态，则置任务
-             * 为就绪状态其中'~(_BLOCKABLE & (*p)->blocked)'用于忽略被阻塞的信号，但
-             * SIGKILL和SIGSTOP不能被阻塞.
-             */
-            if (((*p)->signal & ~(_BLOCKABLE & (*p)->blocked)) &&
-                (*p)->state == TASK_INTERRUPTIBLE)
-                /* 置为就绪(可执行)状态. */
-                (*p)->state = TASK_RUNNING;
-        }
+    /* 还没让出处理器就已经被唤醒，不算唤醒延迟. */
+    if (prev->state == TASK_RUNNING)
+        prev->wake_time = 0;
 
-    /* 这里是调度程序的主要部分: */
+    /**
+     * 当前任务仍可运行，则放回就绪队列，与其它任务一起比较。被更高优先级的实时任务
+     * 抢占的FIFO任务放在同级队列的头部.
+     */
+    if (prev->state == TASK_RUNNING && prev != rq->idle && !prev->run_array)
+    {
+        if (preempted && prev->policy == SCHED_FIFO &&
+            (rq->rt.bitmap >> prev->rt_priority) > 1)
+            enqueue_task_head(prev, &rq->rt);
+        else
+            activate_task(prev);
+    }
 
-    while (1)
+    /* 所有任务的时间片都用完了：交换两组队列，相当于重新计算所有任务的counter. */
+    if (!rq->active->bitmap && rq->expired->bitmap)
     {
-        c = -1;
-        next = 0;
-        i = NR_TASKS;
-        p = &task[NR_TASKS];
+        array = rq->active;
+        rq->active = rq->expired;
+        rq->expired = array;
+        rq->epoch++;
+    }
 
-        /**
-         * 这段代码也是从任务数组的最后一个任务开始循环处理，并跳过不含任务的数组槽。
-         * 比较每个就绪状态任务的counter(任务运行时间的递减滴答计数)值，哪一个值大，
-         * 运行时间还不长，next就指向哪个的任务号.
-         */
-        while (--i)
-        {
-            if (!*--p)
-                continue;
+    /**
+     * 取优先级最高的实时任务，没有则取counter最大的一级队列的第一个任务，都没有
+     * 就运行空闲任务.
+     */
+    if (rq->rt.bitmap)
+    {
+        __asm__("bsrl %1,%0" : "=r"(level) : "rm"(rq->rt.bitmap));
+        next = rq->rt.queue[level];
+        dequeue_task(next);
+    }
+    else if (rq->active->bitmap)
+    {
+        __asm__("bsrl %1,%0" : "=r"(level) : "rm"(rq->active->bitmap));
+        next = rq->active->queue[level];
+        dequeue_task(next);
+    }
+    else
+        next = rq->idle;
+
+    /**
+     * 内核大锁随处理器转给next，各任务持有的嵌套深度不同。next若是新建的任务(或
+     * 切换出去时没有持有大锁)，要先释放，新建的任务在ret_from_fork中自己取得.
+     */
+    if (next != prev)
+    {
+        /* 统计切换次数，记录切换事件，next是被唤醒的则计入唤醒延迟. */
+        if (prev->state == TASK_RUNNING)
+            prev->nivcsw++;
+        else
+            prev->nvcsw++;
 
-            if ((*p)->state == TASK_RUNNING && (*p)->counter > c)
-                c = (*p)->counter, next = i;
+        now = trace_sched_event(SCHED_EV_SWITCH, next, prev);
+
+        if (next->wake_time)
+        {
+            account_wakeup_latency(now - next->wake_time);
+            next->wake_time = 0;
         }
 
-        /* 如果比较得出有counter值大于0的结果，则退出开始的循环，执行任务切换. */
-        if (c)
-            break;
+        prev->lock_depth = kernel_lock_depth;
 
-        /**
-         * 否则就根据每个任务的优先权值，更新每一个任务的counter值，然后回到重新比较。
-         * counter值的计算方式为counter = counter / 2 + priority.
-         */
-        for (p = &LAST_TASK; p > &FIRST_TASK; --p)
-            if (*p)
-                (*p)->counter = ((*p)->counter >> 1) +
-                                (*p)->priority;
+        if (next->lock_depth <= 0)
+            release_kernel_lock();
+        else
+            kernel_lock_depth = next->lock_depth;
     }
 
-    /* 切换到任务号为next的任务，并运行. */
+    /* 切换到任务next，并运行. */
     switch_to(next);
+    restore_flags(flags);
+}
+
+#ifdef NO_HZ_IDLE
+/**
+ * 空闲时停止时钟滴答。没有任务可运行时，任务0把8253改为一次性计数方式(方式0)，
+ * 计数到下一个有定时器到期的滴答为止，然后停机等待中断，这样空闲的系统(特别是
+ * 虚拟机)不必每个滴答都被唤醒一次。stopped_ticks是一次性计数所跨的滴答数，
+ * 0表示8253处于周期方式.
+ *
+ * 一次性计数结束时产生时钟中断，中断入口只给jiffies加了1，tick_restart()补上其余
+ * 的滴答并恢复周期方式。被别的中断提前唤醒时，由tick_idle()读出计数值，补上已经
+ * 过去的整滴答数，并把计数器改为在下一个滴答边界处结束，jiffies因此总是准确的
+ * (只是在停止期间别的中断处理程序看到的jiffies可能落后几个滴答).
+ */
+static long stopped_ticks = 0;
+
+/* 计数器只有16位，一次最多停止的滴答数. */
+#define MAX_STOPPED_TICKS       (0xffff / LATCH)
+
+/* 8253计数器0设为一次性计数方式，count个输入时钟后产生一次时钟中断. */
+static void pit_oneshot(unsigned long count)
+{
+    outb_p(0x30, 0x43);         /* binary, mode 0, LSB/MSB, ch 0 */
+    outb_p(count & 0xff, 0x40);
+    outb(count >> 8, 0x40);
+}
+
+/* 时钟中断中调用：一次性计数已经结束，补上跳过的滴答并恢复周期方式. */
+static void tick_restart(void)
+{
+    jiffies += stopped_ticks - 1;
+    stopped_ticks = 0;
+    pit_periodic();
+}
+
+/* 提前被别的中断唤醒：补上已经过去的滴答，让计数在下一个滴答边界结束. */
+static void tick_wakeup(void)
+{
+    unsigned long status, count, elapsed, ticks;
+
+    /* 读回命令：锁存计数器0的状态和计数值. */
+    outb_p(0xc2, 0x43);
+    status = inb_p(0x40);
+    count = inb_p(0x40);
+    count |= inb_p(0x40) << 8;
+
+    /* 输出已变高说明计数已经结束，时钟中断马上就会处理. */
+    if (status & 0x80)
+        return;
+
+    elapsed = stopped_ticks * LATCH - count;
+    ticks = elapsed / LATCH;
+    jiffies += ticks;
+    stopped_ticks = 1;
+    pit_oneshot(LATCH - elapsed % LATCH);
+}
+
+/**
+ * 任务0在没有其它任务可运行时调用：停止时钟滴答直到下一个定时器到期，然后停机
+ * 等待中断.
+ */
+static void tick_idle(void)
+{
+    struct runqueue *rq = runqueues;
+    long ticks;
+    int depth;
+
+    cli();
+
+    if (rq_busy(rq))
+    {
+        sti();
+        return;
+    }
+
+    if (!hrtimer_needs_tick() && (ticks = timer_idle_ticks(MAX_STOPPED_TICKS)) > 1)
+    {
+        stopped_ticks = ticks;
+        pit_oneshot(ticks * LATCH);
+    }
+
+    /**
+     * sti后的一条指令执行完才开中断，所以不会在hlt之前漏掉中断。停机期间释放内核
+     * 大锁，让其它处理器可以进入内核.
+     */
+    depth = release_kernel_lock();
+    __asm__("sti ; hlt");
+
+    cli();
+    reacquire_kernel_lock(depth);
+
+    if (stopped_ticks)
+        tick_wakeup();
+
+    sti();
+}
+#else
+/* 没有任务可运行时停机等待下一个中断(至多一个滴答). */
+static void tick_idle(void)
+{
+    struct runqueue *rq = runqueues;
+    int depth;
+
+    cli();
+
+    if (!rq_busy(rq))
+    {
+        depth = release_kernel_lock();
+        __asm__("sti ; hlt");
+        cli();
+        reacquire_kernel_lock(depth);
+    }
+
+    sti();
 }
+#endif
 
 /**
  * pause()系统调用。转换当前任务的状态为可中断的等待状态，并重新调度。
@@ -237,6 +736,20 @@ void schedule(void)
  */
 int sys_pause(void)
 {
+    /**
+     * 任务0只在没有其它任务可运行时才执行(schedule()返回到这里说明仍然没有)，
+     * 正好用来准备清零的空闲页面。没有页面要清零了则停机等待中断，而不是一直循环.
+     */
+    if (current == task[0])
+    {
+        schedule();
+
+        if (!fill_zero_pool())
+            tick_idle();
+
+        return 0;
+    }
+
     current->state = TASK_INTERRUPTIBLE;
     schedule();
 
@@ -244,111 +757,171 @@ int sys_pause(void)
 }
 
 /**
- * 把当前任务置为不可中断的等待状态，并让睡眠队列头的指针指向当前任务。
- * 只有明确地唤醒时才会返回。该函数提供了进程与中断处理程序之间的同步机制。
- * 函数参数*p是放置等待任务的队列头指针。
+ * 把等待项wait加到队列*q中。非独占的加在队列头，独占的加在队列尾，这样唤醒时先
+ * 遇到所有非独占的等待者. 调用时中断已关闭.
  */
-void sleep_on(struct task_struct **p)
+static void add_wait_queue(struct wait_queue **q, struct wait_queue *wait)
 {
-    struct task_struct *tmp;
+    struct wait_queue *first = *q;
 
-    /* 若指针无效，则退出. */
-    if (!p)
+    if (!first)
+    {
+        *q = wait->next = wait->prev = wait;
         return;
+    }
 
-    /* 如果当前任务是任务0，则死机(impossible!). */
-    if (current == &(init_task.task))
-        panic("task[0] trying to sleep");
-
-    /* 让tmp指向已经在等待队列上的任务(如果有的话). */
-    tmp = *p;
+    wait->next = first;
+    wait->prev = first->prev;
+    first->prev->next = wait;
+    first->prev = wait;
 
-    /* 将睡眠队列头的等待指针指向当前任务. */
-    *p = current;
+    if (!(wait->flags & WQ_FLAG_EXCLUSIVE))
+        *q = wait;
+}
 
-    /* 将当前任务置为不可中断的等待状态. */
-    current->state = TASK_UNINTERRUPTIBLE;
+/* 从队列*q中取下等待项wait. 调用时中断已关闭. */
+static void remove_wait_queue(struct wait_queue **q, struct wait_queue *wait)
+{
+    if (wait->next == wait)
+        *q = NULL;
+    else
+    {
+        wait->prev->next = wait->next;
+        wait->next->prev = wait->prev;
 
-    /* 重新调度. */
-    schedule();
+        if (*q == wait)
+            *q = wait->next;
+    }
 
-    /**
-     * 只有当这个等待任务被唤醒时，调度程序才又返回到这里，则表示进程已被明确地唤醒。
-     * 既然大家都在等待同样的资源，那么在资源可用时，就有必要唤醒所有等待该资源的进程。
-     * 该函数嵌套调用，也会嵌套唤醒所有等待该资源的进程。然后系统会根据这些进程的优先
-     * 条件，重新调度应该由哪个进程首先使用资源。也即让这些进程竞争上岗.
-     * 若还存在等待的任务，则也将其置为就绪状态(唤醒).
-     */
-    if (tmp)
-        tmp->state = 0;
+    wait->next = wait->prev = NULL;
 }
 
 /**
- * 将当前任务置为可中断的等待状态，并放入*p指定的等待队列中.
+ * 把当前任务置为state状态并在队列*q上等待，直到被唤醒(可中断的等待也可能被信号
+ * 唤醒)。调用者应在醒来后重新检查所等待的条件.
  */
-void interruptible_sleep_on(struct task_struct **p)
+static void __sleep_on(struct wait_queue **q, long state, int flags)
 {
-    struct task_struct *tmp;
+    struct wait_queue wait;
+    unsigned long eflags;
 
-    if (!p)
+    /* 若指针无效，则退出. */
+    if (!q)
         return;
 
-    if (current == &(init_task.task))
-        panic("task[0] trying to sleep");
+    /* 如果当前任务是空闲任务，则死机(impossible!). */
+    if (current == this_rq()->idle)
+        panic("idle task trying to sleep");
 
-    tmp = *p;
-    *p = current;
+    wait.task = current;
+    wait.flags = flags;
 
-repeat:
-    current->state = TASK_INTERRUPTIBLE;
+    save_flags(eflags);
+    cli();
+    current->state = state;
+    add_wait_queue(q, &wait);
     schedule();
+    remove_wait_queue(q, &wait);
+    restore_flags(eflags);
+}
 
-    /**
-     * 如果等待队列中还有等待任务，并且队列头指针所指向的任务不是当前任务时，
-     * 则将该等待任务置为可运行的就绪状态，并重新执行调度程序。当指针*p 所指向
-     * 的不是当前任务时，表示在当前任务被放入队列后，又有新的任务被插入等待队列中，
-     * 因此，既然本任务是可中断的，就应该首先执行所有其它的等待任务.
-     */
-    if (*p && *p != current)
-    {
-        (**p).state = 0;
-        goto repeat;
-    }
+/**
+ * 把当前任务置为不可中断的等待状态，在队列*q上等待。只有明确地唤醒时才会返回。
+ * 该函数提供了进程与中断处理程序之间的同步机制.
+ */
+void sleep_on(struct wait_queue **q)
+{
+    __sleep_on(q, TASK_UNINTERRUPTIBLE, 0);
+}
 
-    /**
-     * 下面一句代码有误，应该是*p = tmp，让队列头指针指向其余等待任务，否则在当前
-     * 任务之前插入等待队列的任务均被抹掉了.
-     */
-    *p = NULL;
+/**
+ * 与sleep_on()相同，但作为独占的等待者：同时等待的任务中每次只有一个被wake_up()
+ * 唤醒。用于等待锁或空闲资源，醒来的任务要么占用资源，要么再次睡眠.
+ */
+void sleep_on_exclusive(struct wait_queue **q)
+{
+    __sleep_on(q, TASK_UNINTERRUPTIBLE, WQ_FLAG_EXCLUSIVE);
+}
 
-    if (tmp)
-        tmp->state = 0;
+/**
+ * 将当前任务置为可中断的等待状态，在队列*q上等待。除了wake_up()，信号也能唤醒它.
+ */
+void interruptible_sleep_on(struct wait_queue **q)
+{
+    __sleep_on(q, TASK_INTERRUPTIBLE, 0);
 }
 
 /**
- * 唤醒指定任务*p.
+ * 唤醒队列*q上的任务：所有非独占的等待者，以及nr_exclusive个独占的等待者(为0
+ * 则全部唤醒)。已经被唤醒而还没有运行的任务不算在内，否则一次释放资源的唤醒会
+ * 落空。可以在中断处理程序中调用.
  */
-void wake_up(struct task_struct **p)
+void __wake_up(struct wait_queue **q, int nr_exclusive)
 {
-    if (p && *p)
+    struct wait_queue *wait, *first;
+    unsigned long flags;
+
+    if (!q || !*q)
+        return;
+
+    save_flags(flags);
+    cli();
+
+    wait = first = *q;
+
+    do
     {
+        if (wait->task->state == TASK_RUNNING)
+            continue;
+
+        trace_sched_event(SCHED_EV_WAKEUP, wait->task, current);
+
         /* 置为就绪(可运行)状态. */
-        (**p).state = 0;
-        *p = NULL;
-    }
+        wake_up_process(wait->task);
+
+        if ((wait->flags & WQ_FLAG_EXCLUSIVE) && !--nr_exclusive)
+            break;
+    } while ((wait = wait->next) != first);
+
+    restore_flags(flags);
 }
 
 /**
  * 好了，从这里开始是一些有关软盘的子程序，本不应该放在内核的主要部分中的。
  * 将它们放在这里是因为软驱需要一个时钟，而放在这里是最方便的办法.
  */
-static struct task_struct *wait_motor[4] = {NULL, NULL, NULL, NULL};
-static int mon_timer[4] = {0, 0, 0, 0};
-static int moff_timer[4] = {0, 0, 0, 0};
+static struct wait_queue *wait_motor[4] = {NULL, NULL, NULL, NULL};
 
 /* 数字输出寄存器(初值：允许DMA和请求中断、启动FDC). */
 unsigned char current_DOR = 0x0C;
 
+/* 软驱nr的马达启动时间到，唤醒等待的进程. */
+static void motor_on_callback(unsigned long nr)
+{
+    wake_up(nr + wait_motor);
+}
+
+/* 软驱nr的马达停转时间到，复位数字输出寄存器中相应的马达启动位. */
+static void motor_off_callback(unsigned long nr)
+{
+    current_DOR &= ~(0x10 << nr);
+    outb(current_DOR, FD_DOR);
+}
+
+/* 各软驱的马达启动定时器和马达停转定时器. */
+static struct timer_list motor_on_timer[4] = {
+    {NULL, NULL, 0, 0, motor_on_callback},
+    {NULL, NULL, 0, 1, motor_on_callback},
+    {NULL, NULL, 0, 2, motor_on_callback},
+    {NULL, NULL, 0, 3, motor_on_callback}
+};
+static struct timer_list motor_off_timer[4] = {
+    {NULL, NULL, 0, 0, motor_off_callback},
+    {NULL, NULL, 0, 1, motor_off_callback},
+    {NULL, NULL, 0, 2, motor_off_callback},
+    {NULL, NULL, 0, 3, motor_off_callback}
+};
+
 /**
  * 指定软盘到正常运转状态所需延迟滴答数(时间).
  * nr -- 软驱号(0-3)，返回值为滴答数.
@@ -360,12 +933,14 @@ int ticks_to_floppy_on(unsigned int nr)
 
     /* 所选软驱对应数字输出寄存器中启动马达比特位. */
     unsigned char mask = 0x10 << nr;
+    long ticks;
 
     /* 最多4个软驱. */
     if (nr > 3)
         panic("floppy_on: nr>3");
 
-    moff_timer[nr] = 10000; /* 100 s = very big :-) */
+    /* 取消马达停转定时，由floppy_off()重新设置. */
+    del_timer(motor_off_timer + nr);
 
     cli();                  /* use floppy_off to turn it off */
 
@@ -380,24 +955,32 @@ int ticks_to_floppy_on(unsigned int nr)
 
     /**
      * 如果数字输出寄存器的当前值与要求的值不同，则向FDC数字输出端口输出新值(mask)。
-     * 并且如果要求启动的马达还没有启动，则置相应软驱的马达启动定时器值(HZ/2 = 0.5秒
-     * 或 50 个滴答)。此后更新当前数字输出寄存器值current_DOR.
+     * 并且如果要求启动的马达还没有启动，则置相应软驱的马达启动定时器(HZ/2 = 0.5秒)，
+     * 否则至少等待20ms。此后更新当前数字输出寄存器值current_DOR.
      */
     if (mask != current_DOR)
     {
         outb(mask, FD_DOR);
 
         if ((mask ^ current_DOR) & 0xf0)
-            mon_timer[nr] = HZ / 2;
-        else if (mon_timer[nr] < 2)
-            mon_timer[nr] = 2;
+            mod_timer(motor_on_timer + nr, jiffies + HZ / 2);
+        else if (!timer_pending(motor_on_timer + nr) ||
+                 (long)(motor_on_timer[nr].expires - jiffies) < (HZ + 49) / 50)
+            mod_timer(motor_on_timer + nr, jiffies + (HZ + 49) / 50);
 
         current_DOR = mask;
     }
 
+    /* 马达启动定时器还挂着则返回剩余的滴答数(至少为1). */
+    ticks = 0;
+
+    if (timer_pending(motor_on_timer + nr))
+        if ((ticks = motor_on_timer[nr].expires - jiffies) < 1)
+            ticks = 1;
+
     sti();
 
-    return mon_timer[nr];
+    return ticks;
 }
 
 /**
@@ -424,107 +1007,82 @@ void floppy_on(unsigned int nr)
  */
 void floppy_off(unsigned int nr)
 {
-    moff_timer[nr] = 3 * HZ;
+    mod_timer(motor_off_timer + nr, jiffies + 3 * HZ);
 }
 
+/* 各处理器时间片计数的余数，见update_process_times(). */
+static long slice_acc[NR_CPUS];
+
 /**
- * 软盘定时处理子程序。更新马达启动定时值和马达关闭停转计时值。该子程序是
- * 在时钟定时中断中被调用，因此每一个滴答(10ms)被调用一次，更新马达开启或
- * 停转定时器的值。如果某一个马达停转定时到，则将数字输出寄存器马达启动位复位.
+ * 每个时钟滴答对当前任务计时，时间片用完则重新调度。引导处理器在do_timer()中调用，
+ * 其它处理器在本地APIC定时器中断中调用(kernel/smp.c)。参数cpl同do_timer().
  */
-void do_floppy_timer(void)
+void update_process_times(long cpl)
 {
-    int i;
-    unsigned char mask = 0x10;
+    long *acc = slice_acc + smp_processor_id();
 
-    for (i = 0; i < 4; i++, mask <<= 1)
+    /**
+     * 如果当前特权级(cpl)为0(最高，表示是内核程序在工作)，则将超级用户运行时间
+     * stime递增；如果cpl > 0，则表示是一般用户程序在工作，增加utime.
+     */
+    if (cpl)
+        current->utime++;
+    else
+        current->stime++;
+
+    /* FIFO任务没有时间片. */
+    if (current->policy == SCHED_FIFO)
+        return;
+
+    /**
+     * 时间片counter以10ms为单位，与HZ无关：每个滴答累加100，每满HZ就给当前任务的
+     * counter减1。如果进程运行时间还没完，则退出.
+     */
+    *acc += 100;
+
+    if (*acc < HZ)
+        return;
+
+    do
     {
-        /* 如果不是DOR指定的马达则跳过. */
-        if (!(mask & current_DOR))
-            continue;
+        *acc -= HZ;
+        current->counter--;
+    } while (*acc >= HZ);
 
-        if (mon_timer[i])
-        {
-            /* 如果马达启动定时到则唤醒进程. */
-            if (!--mon_timer[i])
-                wake_up(i + wait_motor);
-        }
-        /* 如果马达停转定时到则,复位相应马达启动位，并更新数字输出寄存器. */
-        else if (!moff_timer[i])
-        {
-            current_DOR &= ~mask;
-            outb(current_DOR, FD_DOR);
-        }
-        else
-            moff_timer[i]--;    /* 马达停转计时递减. */
-    }
-}
+    if (current->counter > 0)
+        return;
 
-/* 最多可有64个定时器链表(64个任务). */
-#define TIME_REQUESTS               64
+    current->counter = 0;
 
-/* 定时器链表结构和定时器数组. */
-static struct timer_list
-{
-    long jiffies;               /* 定时滴答数. */
-    void (*fn)();               /* 定时处理程序. */
-    struct timer_list *next;    /* 下一个定时器. */
-} timer_list[TIME_REQUESTS], *next_timer = NULL;
+    /* 对于超级用户程序，不依赖counter值进行调度. */
+    if (!cpl)
+        return;
+
+    schedule();
+}
 
 /**
- * 添加定时器。输入参数为指定的定时值(滴答数)和相应的处理程序指针.
- * jiffies – 以10毫秒计的滴答数；*fn() - 定时时间到时执行的函数.
+ * 其它处理器的空闲循环(kernel/smp.c启动处理器后调用)，相当于引导处理器上任务0
+ * 的pause()循环：有任务就调度，没有则释放内核大锁，停机等待中断(APIC定时器或
+ * 别的处理器发来的处理器间中断).
  */
-void add_timer(long jiffies, void (*fn)(void))
+void cpu_idle(void)
 {
-    struct timer_list *p;
+    struct runqueue *rq = this_rq();
 
-    /* 如果定时处理程序指针为空，则退出. */
-    if (!fn)
-        return;
+    for (;;)
+    {
+        lock_kernel();
+        schedule();
+        unlock_kernel();
 
-    cli();
+        cli();
 
-    /* 如果定时值<=0，则立刻调用其处理程序。并且该定时器不加入链表中. */
-    if (jiffies <= 0)
-        (fn)();
-    else
-    {
-        /* 从定时器数组中，找一个空闲项. */
-        for (p = timer_list; p < timer_list + TIME_REQUESTS; p++)
-            if (!p->fn)
-                break;
-
-        /* 如果已经用完了定时器数组，则系统崩溃. */
-        if (p >= timer_list + TIME_REQUESTS)
-            panic("No more time requests free");
-
-        /* 向定时器数据结构填入相应信息。并链入链表头. */
-        p->fn = fn;
-        p->jiffies = jiffies;
-        p->next = next_timer;
-        next_timer = p;
-
-        /**
-         * 链表项按定时值从小到大排序。在排序时减去排在前面需要的滴答数，这样在
-         * 处理定时器时只要查看链表头的第一项的定时是否到期即可。[[?? 这段程序
-         * 好象没有考虑周全。如果新插入的定时器值 < 原来头一个定时器值时，也应该
-         * 将所有后面的定时值均减去新的第 1 个的定时值。]]
-         */
-        while (p->next && p->next->jiffies < p->jiffies)
-        {
-            p->jiffies -= p->next->jiffies;
-            fn = p->fn;
-            p->fn = p->next->fn;
-            p->next->fn = fn;
-            jiffies = p->jiffies;
-            p->jiffies = p->next->jiffies;
-            p->next->jiffies = jiffies;
-            p = p->next;
-        }
-    }
+        if (!rq_busy(rq))
+            __asm__("sti ; hlt");
 
-    sti();
+        sti();
+    }
 }
 
 /**
@@ -534,65 +1092,49 @@ void add_timer(long jiffies, void (*fn)(void))
  */
 void do_timer(long cpl)
 {
-    /* 扬声器发声时间滴答数(kernel/chr_drv/console.c). */
-    extern int beepcount;
-    /* 关闭扬声器(kernel/chr_drv/console.c). */
-    extern void sysbeepstop(void);
-
-    /**
-     * 如果发声计数次数到，则关闭发声。(向0x61口发送命令，复位位0和1。位0控制
-     * 8253计数器2的工作，位1控制扬声器).
-     */
-    if (beepcount)
-        if (!--beepcount)
-            sysbeepstop();
-
-    /**
-     * 如果当前特权级(cpl)为0(最高，表示是内核程序在工作)，则将超级用户运行时间
-     * stime递增；如果cpl > 0，则表示是一般用户程序在工作，增加utime.
-     */
-    if (cpl)
-        current->utime++;
-    else
-        current->stime++;
+#ifdef NO_HZ_IDLE
+    /* 时钟滴答停止过，先补上跳过的滴答. */
+    if (stopped_ticks)
+        tick_restart();
+#endif
 
-    /**
-     * 如果有用户的定时器存在，则将链表第1个定时器的值减1。如果已等于0，则调用相
-     * 应的处理程序，并将该处理程序指针置为空。然后去掉该项定时器.
-     */
-    /* next_timer是定时器链表的头指针. */
-    if (next_timer)
-    {
-        next_timer->jiffies--;
-        while (next_timer && next_timer->jiffies <= 0)
-        {
-            /* 这里插入了一个函数指针定义. */
-            void (*fn)(void);
+    /* 处理到期的定时器(软驱马达、蜂鸣、alarm等，见kernel/timer.c). */
+    run_timers();
 
-            fn = next_timer->fn;
-            next_timer->fn = NULL;
-            next_timer = next_timer->next;
+    /* 没有TSC时高精度定时器也在这里处理(kernel/hrtimer.c). */
+    run_hrtimers();
 
-            /* 调用处理函数. */
-            (fn)();
-        }
-    }
+    /* 当前任务计时，时间片用完则重新调度. */
+    update_process_times(cpl);
+}
 
-    /* 如果当前软盘控制器FDC的数字输出寄存器中马达启动位有置位的，则执行软盘定时程序. */
-    if (current_DOR & 0xf0)
-        do_floppy_timer();
+/* 进程的alarm定时器到期：发送SIGALRM信号. */
+static void it_real_fn(unsigned long data)
+{
+    struct task_struct *p = (struct task_struct *)data;
 
-    /* 如果进程运行时间还没完，则退出. */
-    if ((--current->counter) > 0)
-        return;
+    p->alarm = 0;
+    p->signal |= (1 << (SIGALRM - 1));
+    signal_wake_up(p);
+}
 
-    current->counter = 0;
+/**
+ * 设置任务p的报警时刻为expires(jiffies值)，0表示取消。alarm字段只记录时刻，
+ * 到期由定时器轮负责，调度时不再扫描各任务的alarm.
+ */
+void set_alarm(struct task_struct *p, long expires)
+{
+    p->alarm = expires;
 
-    /* 对于超级用户程序，不依赖counter值进行调度. */
-    if (!cpl)
+    if (!expires)
+    {
+        del_timer(&p->real_timer);
         return;
+    }
 
-    schedule();
+    p->real_timer.data = (unsigned long)p;
+    p->real_timer.function = it_real_fn;
+    mod_timer(&p->real_timer, expires);
 }
 
 /**
@@ -605,7 +1147,7 @@ int sys_alarm(long seconds)
 
     if (old)
         old = (old - jiffies) / HZ;
-    current->alarm = (seconds > 0) ? (jiffies + HZ * seconds) : 0;
+    set_alarm(current, (seconds > 0) ? (jiffies + HZ * seconds) : 0);
 
     return (old);
 }
@@ -670,34 +1212,151 @@ int sys_nice(long increment)
     return 0;
 }
 
+/* 取进程号为pid的任务，pid为0表示当前任务. */
+static struct task_struct *find_task_by_pid(int pid)
+{
+    struct task_struct **p;
+
+    if (!pid)
+        return current;
+
+    for (p = &LAST_TASK; p > &FIRST_TASK; --p)
+        if (*p && (*p)->pid == pid)
+            return *p;
+
+    return NULL;
+}
+
+/**
+ * 设置进程pid的调度策略和实时优先级，policy为-1表示不改变策略(sched_setparam())。
+ * 只有超级用户可以设置实时策略；改变别人的进程要求有效用户号相同。任务若在就绪队列
+ * 中，要先取下再按新的级数放回，并让它所在的处理器重新调度.
+ */
+static int setscheduler(int pid, int policy, struct sched_param *param)
+{
+    struct task_struct *p;
+    unsigned long flags;
+    int prio;
+
+    if (!param || pid < 0)
+        return -EINVAL;
+
+    prio = get_fs_long((unsigned long *)&param->sched_priority);
+
+    if (!(p = find_task_by_pid(pid)) || p == task[0])
+        return -ESRCH;
+
+    if (policy < 0)
+        policy = p->policy;
+
+    if (policy != SCHED_OTHER && policy != SCHED_FIFO && policy != SCHED_RR)
+        return -EINVAL;
+
+    if (policy == SCHED_OTHER ? prio != 0 : (prio < RT_PRIO_MIN || prio > RT_PRIO_MAX))
+        return -EINVAL;
+
+    if (policy != SCHED_OTHER && !suser())
+        return -EPERM;
+
+    if (current->euid != p->euid && !suser())
+        return -EPERM;
+
+    save_flags(flags);
+    cli();
+
+    if (p->run_array)
+    {
+        dequeue_task(p);
+        p->policy = policy;
+        p->rt_priority = prio;
+        activate_task(p);
+    }
+    else
+    {
+        p->policy = policy;
+        p->rt_priority = prio;
+    }
+
+    current_set[p->processor]->need_resched = 1;
+    restore_flags(flags);
+
+    return 0;
+}
+
+/**
+ * 系统调用功能 -- 设置调度策略和实时优先级.
+ */
+int sys_sched_setscheduler(int pid, int policy, struct sched_param *param)
+{
+    if (policy < 0)
+        return -EINVAL;
+
+    return setscheduler(pid, policy, param);
+}
+
+/**
+ * 系统调用功能 -- 取调度策略.
+ */
+int sys_sched_getscheduler(int pid)
+{
+    struct task_struct *p;
+
+    if (pid < 0 || !(p = find_task_by_pid(pid)))
+        return -ESRCH;
+
+    return p->policy;
+}
+
+/**
+ * 系统调用功能 -- 只设置实时优先级.
+ */
+int sys_sched_setparam(int pid, struct sched_param *param)
+{
+    return setscheduler(pid, -1, param);
+}
+
+/**
+ * 系统调用功能 -- 取实时优先级.
+ */
+int sys_sched_getparam(int pid, struct sched_param *param)
+{
+    struct task_struct *p;
+
+    if (!param || pid < 0)
+        return -EINVAL;
+
+    if (!(p = find_task_by_pid(pid)))
+        return -ESRCH;
+
+    verify_area(param, sizeof *param);
+    put_fs_long(p->rt_priority, (unsigned long *)&param->sched_priority);
+
+    return 0;
+}
+
 /**
  * 调度程序的初始化子程序.
  */
 void sched_init(void)
 {
     int i;
-    /* 描述符表结构指针. */
-    struct desc_struct *p;
 
     /* sigaction是存放有关信号状态的结构. */
     if (sizeof(struct sigaction) != 16)
         panic("Struct sigaction MUST be 16 bytes");
 
-    /* 设置初始任务(任务0)的任务状态段描述符和局部数据表描述符(include/asm/system.h). */
-    set_tss_desc(gdt + FIRST_TSS_ENTRY, &(init_task.task.tss));
-    set_ldt_desc(gdt + FIRST_LDT_ENTRY, &(init_task.task.ldt));
+    /* 各处理器的就绪队列，引导处理器的空闲任务是任务0. */
+    for (i = 0; i < NR_CPUS; i++)
+    {
+        runqueues[i].active = runqueues[i].arrays;
+        runqueues[i].expired = runqueues[i].arrays + 1;
+    }
 
-    /* 清任务数组和描述符表项(注意i=1开始，所以初始任务的描述符还在). */
-    p = gdt + 2 + FIRST_TSS_ENTRY;
+    runqueues[0].idle = &(init_task.task);
 
+    /* 清任务数组(注意i=1开始，任务0还在). */
     for (i = 1; i < NR_TASKS; i++)
-    {
         task[i] = NULL;
-        p->a = p->b = 0;
-        p++;
-        p->a = p->b = 0;
-        p++;
-    }
 
     /* 清除标志寄存器中的位NT，这样以后就不会有麻烦. */
     /**
@@ -706,21 +1365,14 @@ void sched_init(void)
      */
     __asm__("pushfl ; andl $0xffffbfff,(%esp) ; popfl");    /* 复位NT标志. */
 
-    /* 将任务0的TSS加载到任务寄存器t. */
-    ltr(0);
-
-    /* 将局部描述符表加载到局部描述符表寄存器. */
-    lldt(0);
-
     /**
-     * 注意!!是将GDT中相应LDT描述符的选择符加载到ldtr。只明确加载这一次，以后新任务
-     * LDT的加载，是CPU根据TSS中的LDT项自动加载.
+     * 设置并加载引导处理器的TSS和LDT。以后任务切换不再改变任务寄存器和ldtr，只改写
+     * 其中的内容(见__switch_to()).
      */
+    cpu_init(0);
 
     /* 下面代码用于初始化8253定时器. */
-    outb_p(0x36, 0x43);         /* binary, mode 3, LSB/MSB, ch 0 */
-    outb_p(LATCH & 0xff, 0x40); /* LSB,定时值低字节. */
-    outb(LATCH >> 8, 0x40);     /* MSB,定时值高字节. */
+    pit_periodic();
 
     /* 设置时钟中断处理程序句柄(设置时钟中断门). */
     set_intr_gate(0x20, &timer_interrupt);
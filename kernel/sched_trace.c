@@ -0,0 +1,132 @@
+/*
+ *  linux/kernel/sched_trace.c
+ */
+
+/**
+ * 调度事件跟踪和唤醒延迟统计，由schedule()、wake_up_process()和__wake_up()
+ * (kernel/sched.c)调用，用户用sched_trace()系统调用读出(见<sys/sched_trace.h>)。
+ * 环形缓冲区的下标用不断增加的序号，对缓冲区大小取模，写满时推着读位置前进.
+ */
+#include <errno.h>
+#include <sys/sched_trace.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/hrtimer.h>
+#include <asm/system.h>
+#include <asm/segment.h>
+
+/* 环形缓冲区的事件数，必须是2的幂. */
+#define NR_SCHED_EVENTS         256
+
+static struct sched_event events[NR_SCHED_EVENTS];
+static unsigned long ev_head = 0;           /* 下一个事件写入的序号. */
+static unsigned long ev_tail = 0;           /* 最早的未读事件的序号. */
+static struct sched_trace_stat trace_stat;
+
+/**
+ * 记录一个type类型的事件，p和other是事件涉及的任务(other可以为NULL)。返回事件的
+ * 时间戳，调用者可以拿它计算延迟。可以在中断处理程序中调用.
+ */
+unsigned long long trace_sched_event(int type, struct task_struct *p, struct task_struct *other)
+{
+    struct sched_event *ev;
+    unsigned long long now = ktime_get();
+    unsigned long flags;
+
+    save_flags(flags);
+    cli();
+
+    if (ev_head - ev_tail == NR_SCHED_EVENTS)
+    {
+        ev_tail++;
+        trace_stat.lost++;
+    }
+
+    ev = events + (ev_head++ & (NR_SCHED_EVENTS - 1));
+    ev->time = now;
+    ev->type = type;
+    ev->cpu = smp_processor_id();
+    ev->pid = p->pid;
+    ev->other = other ? other->pid : -1;
+
+    restore_flags(flags);
+
+    return now;
+}
+
+/**
+ * 任务被唤醒后经过ns纳秒才开始运行，计入直方图。ns>>10按2的幂分格，用bsrl取
+ * 最高位，不需要64位除法.
+ */
+void account_wakeup_latency(unsigned long long ns)
+{
+    unsigned long us = (unsigned long)(ns >> 10);
+    int i = 0;
+
+    if (ns >> 32)
+        i = NR_LAT_BUCKETS - 1;
+    else if (us)
+    {
+        __asm__("bsrl %1,%0" : "=r"(i) : "rm"(us));
+
+        if (++i > NR_LAT_BUCKETS - 1)
+            i = NR_LAT_BUCKETS - 1;
+    }
+
+    trace_stat.latency[i]++;
+}
+
+/**
+ * 系统调用：把最多count个最早的未读事件按顺序复制到buf并从缓冲区中取走，返回复制
+ * 的个数；st不为NULL时还在其中返回丢失的事件数和唤醒延迟直方图。buf可以为NULL(这时
+ * count应为0)，只取统计。事件中有其它进程的pid和调度时刻，只有超级用户才能读.
+ */
+int sys_sched_trace(struct sched_event *buf, int count, struct sched_trace_stat *st)
+{
+    struct sched_event ev;
+    unsigned long flags;
+    int i, n;
+
+    if (!suser())
+        return -EPERM;
+
+    if (count < 0 || (count && !buf))
+        return -EINVAL;
+
+    /* 缓冲区中最多只有NR_SCHED_EVENTS个事件，这样count * sizeof *buf也不会溢出. */
+    if (count > NR_SCHED_EVENTS)
+        count = NR_SCHED_EVENTS;
+
+    if (count)
+        verify_area(buf, count * sizeof *buf);
+
+    for (n = 0; n < count; n++)
+    {
+        /* 一次取一个事件，往用户空间复制时(可能缺页)不关中断. */
+        save_flags(flags);
+        cli();
+
+        if (ev_tail == ev_head)
+        {
+            restore_flags(flags);
+            break;
+        }
+
+        ev = events[ev_tail++ & (NR_SCHED_EVENTS - 1)];
+        restore_flags(flags);
+
+        for (i = 0; i < sizeof ev / 4; i++)
+            put_fs_long(((unsigned long *)&ev)[i], (unsigned long *)(buf + n) + i);
+    }
+
+    if (st)
+    {
+        verify_area(st, sizeof *st);
+
+        for (i = 0; i < sizeof trace_stat / 4; i++)
+            put_fs_long(((unsigned long *)&trace_stat)[i], (unsigned long *)st + i);
+    }
+
+    return n;
+}
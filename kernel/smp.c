@@ -0,0 +1,562 @@
+/*
+ *  linux/kernel/smp.c
+ */
+
+/**
+ * 多处理器支持。
+ *
+ * 启动：smp_scan()在内存初始化之前按MP规范查找浮动指针结构和配置表，记下各处理器
+ * 本地APIC的编号；smp_boot_cpus()在初始化全部做完并开中断之后，把实模式启动代码
+ * (kernel/trampoline.s)复制到1MB以下的一页中，逐个向其它处理器(AP)发送INIT和
+ * STARTUP处理器间中断。AP从那里进入保护模式、开启分页，在smp_callin()中设置本地
+ * APIC、空闲任务和APIC定时器，然后进入空闲循环(kernel/sched.c中的cpu_idle())。
+ *
+ * 内核大锁：进入内核(系统调用、异常和中断)时取得，返回时释放，同一处理器上可以
+ * 嵌套。调度时锁随处理器转给下一个任务，处理器空闲时释放。同一时刻只有一个处理器
+ * 在执行内核代码，外部中断又只送到引导处理器，所以原来用cli/sti保护的代码不必修改.
+ * 刷新TLB的处理器间中断不取大锁，否则会与持有大锁的发送者死锁.
+ */
+
+#include <string.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/head.h>
+#include <asm/system.h>
+
+/* 签名按小端存放的32位值. */
+#define MPF_SIGNATURE           ('_' | ('M' << 8) | ('P' << 16) | ('_' << 24))
+#define MPC_SIGNATURE           ('P' | ('C' << 8) | ('M' << 16) | ('P' << 24))
+
+/* MP浮动指针结构. */
+struct mp_floating
+{
+    unsigned long signature;    /* "_MP_" */
+    unsigned long physptr;      /* 配置表的物理地址. */
+    unsigned char length;       /* 结构长度(16字节为单位). */
+    unsigned char specification;
+    unsigned char checksum;
+    unsigned char feature1;     /* 非0表示使用某种默认配置，没有配置表. */
+    unsigned char feature2;     /* 位7：引导时处于PIC方式(8259A直接接到引导处理器). */
+    unsigned char feature3, feature4, feature5;
+};
+
+/* MP配置表头，其后是count个表项. */
+struct mp_config_table
+{
+    unsigned long signature;    /* "PCMP" */
+    unsigned short length;
+    char spec;
+    char checksum;
+    char oem[8];
+    char productid[12];
+    unsigned long oemptr;
+    unsigned short oemsize;
+    unsigned short count;
+    unsigned long lapic;        /* 本地APIC的物理地址. */
+    unsigned short extlength;
+    unsigned char extchecksum;
+    unsigned char reserved;
+};
+
+/* 配置表中的处理器表项，其它类型的表项都是8字节. */
+#define MP_PROCESSOR            0
+
+struct mpc_processor
+{
+    unsigned char type;
+    unsigned char apicid;
+    unsigned char apicver;
+    unsigned char cpuflag;      /* 位0：可用. */
+    unsigned long cpufeature;
+    unsigned long featureflag;
+    unsigned long reserved[2];
+};
+
+/* 中断命令寄存器(ICR)的各位. */
+#define APIC_DM_FIXED           0x00000
+#define APIC_DM_INIT            0x00500
+#define APIC_DM_STARTUP         0x00600
+#define APIC_ICR_BUSY           0x01000
+#define APIC_INT_ASSERT         0x04000
+#define APIC_INT_LEVELTRIG      0x08000
+#define APIC_DEST_ALLBUT        0xC0000
+
+/* 本地向量表(LVT)项的各位. */
+#define APIC_LVT_MASKED         0x10000
+#define APIC_LVT_PERIODIC       0x20000
+#define APIC_DM_NMI             0x00400
+#define APIC_DM_EXTINT          0x00700
+
+/* 本地APIC寄存器映射的线性地址，0表示没有映射(单处理器). */
+unsigned long apic_base = 0;
+/* 已经启动的处理器数. */
+int smp_num_cpus = 1;
+/* 由本地APIC编号得到处理器编号. */
+unsigned char apic_to_cpu[256];
+
+/* 配置表中所有可用处理器的APIC编号. */
+static unsigned char mp_apicid[NR_CPUS];
+static int mp_nr_cpus = 0;
+static unsigned long mp_lapic = 0;
+static int pic_mode = 0;
+
+/* 各处理器的APIC编号，已启动的处理器位图. */
+static unsigned char cpu_apicid[NR_CPUS];
+static unsigned long cpu_online_map = 1;
+
+/* APIC定时器在一个滴答内的计数值(各处理器的总线时钟相同，由引导处理器测定). */
+static unsigned long apic_timer_count = 0;
+
+/* 内核大锁。kernel_lock_depth是持有者的嵌套深度，只由持有者修改. */
+static volatile unsigned long kernel_flag = 0;
+static volatile unsigned char kernel_lock_owner = NO_PROC_ID;
+int kernel_lock_depth = 0;
+
+/* 需要刷新TLB的处理器位图，见smp_flush_tlb(). */
+static volatile unsigned long smp_invalidate_needed = 0;
+
+/* 传给正在启动的AP(kernel/trampoline.s)：初始堆栈和控制寄存器. */
+unsigned long ap_stack = 0;
+unsigned long ap_cr0 = 0;
+unsigned long ap_cr4 = 0;
+static struct task_struct *volatile ap_idle = NULL;
+static volatile int cpu_callin = 0;
+
+/* 启动代码要放在1MB以下的页边界处，从这里取一页. */
+static char trampoline_area[2 * PAGE_SIZE];
+
+extern char trampoline[], trampoline_end[];
+
+/* 中断入口(kernel/system_call.s). */
+extern void apic_timer_interrupt(void);
+extern void reschedule_interrupt(void);
+extern void invalidate_interrupt(void);
+extern void spurious_interrupt(void);
+
+/* 求len字节的校验和，正确的表应为0. */
+static int mp_checksum(unsigned char *p, int len)
+{
+    unsigned char sum = 0;
+
+    while (len--)
+        sum += *p++;
+
+    return sum;
+}
+
+/* 在物理地址[base, base+length)中查找浮动指针结构(16字节对齐). */
+static struct mp_floating *mp_scan(unsigned long base, unsigned long length)
+{
+    struct mp_floating *mpf = (struct mp_floating *)base;
+
+    for (; length >= 16; mpf++, length -= 16)
+        if (mpf->signature == MPF_SIGNATURE && mpf->length == 1 &&
+            !mp_checksum((unsigned char *)mpf, 16))
+            return mpf;
+
+    return NULL;
+}
+
+/* 从配置表中取出可用的处理器. */
+static void mp_read_config(struct mp_config_table *mpc)
+{
+    unsigned char *entry = (unsigned char *)(mpc + 1);
+    struct mpc_processor *cpu;
+    int count = mpc->count;
+
+    if (mpc->signature != MPC_SIGNATURE || mp_checksum((unsigned char *)mpc, mpc->length))
+    {
+        printk("SMP: bad MP configuration table\n\r");
+        return;
+    }
+
+    mp_lapic = mpc->lapic;
+
+    while (count-- > 0)
+    {
+        if (*entry != MP_PROCESSOR)
+        {
+            entry += 8;
+            continue;
+        }
+
+        cpu = (struct mpc_processor *)entry;
+        entry += sizeof(struct mpc_processor);
+
+        if ((cpu->cpuflag & 1) && mp_nr_cpus < NR_CPUS)
+            mp_apicid[mp_nr_cpus++] = cpu->apicid;
+    }
+}
+
+/**
+ * 查找MP配置，返回找到的处理器数(没有找到为0)。在内存初始化之前调用，这时只有
+ * 前16MB物理内存有映射，1MB以下也还没有被缓冲区覆盖。BIOS数据区已被内核覆盖
+ * (setup.s把系统移到了0处)，所以不能从中取扩展BIOS数据区的地址，只找640KB以下
+ * 最后1KB和BIOS ROM.
+ */
+int smp_scan(void)
+{
+    struct mp_floating *mpf;
+
+    if (!(cpu_features & CPU_APIC))
+        return 0;
+
+    if (!(mpf = mp_scan(0x9FC00, 0x400)) && !(mpf = mp_scan(0xF0000, 0x10000)))
+        return 0;
+
+    pic_mode = mpf->feature2 & 0x80;
+
+    /* 默认配置：两个处理器，APIC编号为0和1. */
+    if (mpf->feature1)
+    {
+        mp_lapic = 0xFEE00000;
+        mp_apicid[0] = 0;
+        mp_apicid[1] = 1;
+        mp_nr_cpus = 2;
+    }
+    else if (mpf->physptr && mpf->physptr < 16 * 1024 * 1024)
+        mp_read_config((struct mp_config_table *)mpf->physptr);
+
+    if (mp_nr_cpus < 2)
+        mp_nr_cpus = 0;
+
+    return mp_nr_cpus;
+}
+
+/**
+ * 把本地APIC的寄存器页映射到APIC_VADDR(任务0线性空间最后4MB的页表要新分配)，
+ * 不缓存.
+ */
+static int apic_map(void)
+{
+    unsigned long page;
+
+    if (!(page = get_free_page()))
+        return 0;
+
+    ((unsigned long *)page)[(APIC_VADDR >> 12) & 0x3ff] =
+        (mp_lapic & 0xfffff000) | PAGE_PCD | PAGE_PWT | PAGE_RW | PAGE_PRESENT;
+    pg_dir[APIC_VADDR >> 22] = page | PAGE_RW | PAGE_PRESENT;
+    __invalidate();
+    apic_base = APIC_VADDR;
+
+    return 1;
+}
+
+/* 向APIC编号为apicid的处理器发送处理器间中断，cmd是ICR低32位. */
+static void send_ipi(int apicid, unsigned long cmd)
+{
+    unsigned long flags;
+
+    save_flags(flags);
+    cli();
+
+    while (apic_read(APIC_ICR) & APIC_ICR_BUSY)
+        ;
+
+    apic_write(APIC_ICR2, apicid << 24);
+    apic_write(APIC_ICR, cmd);
+    restore_flags(flags);
+}
+
+/* 忙等n个滴答(时钟中断必须已经开启). */
+static void wait_ticks(long n)
+{
+    long j = jiffies + n;
+
+    while ((long)(jiffies - j) < 0)
+        ;
+}
+
+/**
+ * 设置本处理器的本地APIC。虚拟线方式下8259A的中断经LINT0送给引导处理器，其它
+ * 处理器屏蔽LINT0和LINT1.
+ */
+static void setup_local_apic(int bsp)
+{
+    apic_write(APIC_SPIV, 0x100 | SPURIOUS_VECTOR);
+    apic_write(APIC_TPR, 0);
+
+    if (!bsp)
+    {
+        apic_write(APIC_LVT0, APIC_LVT_MASKED | APIC_DM_EXTINT);
+        apic_write(APIC_LVT1, APIC_LVT_MASKED | APIC_DM_NMI);
+    }
+    else if (!pic_mode)
+    {
+        apic_write(APIC_LVT0, APIC_DM_EXTINT);
+        apic_write(APIC_LVT1, APIC_DM_NMI);
+    }
+}
+
+/* 测定APIC定时器(不分频)一个滴答的计数值. */
+static void calibrate_apic_timer(void)
+{
+    long j;
+
+    apic_write(APIC_TDCR, 0xB);
+    apic_write(APIC_LVTT, APIC_LVT_MASKED | LOCAL_TIMER_VECTOR);
+
+    j = jiffies;
+
+    while (jiffies == j)
+        ;
+
+    apic_write(APIC_TMICT, 0xffffffff);
+    j = jiffies;
+
+    while (jiffies == j)
+        ;
+
+    apic_timer_count = 0xffffffff - apic_read(APIC_TMCCT);
+    apic_write(APIC_TMICT, 0);
+}
+
+/**
+ * AP的C入口(kernel/trampoline.s)，在空闲任务的堆栈上执行，中断关闭。设置好后进入
+ * 空闲循环，不再返回.
+ */
+void smp_callin(void)
+{
+    int cpu = apic_to_cpu[apic_read(APIC_ID) >> 24];
+
+    setup_local_apic(0);
+    init_idle(ap_idle, cpu);
+    cpu_init(cpu);
+
+    /* APIC定时器周期方式，作为本处理器的时钟滴答. */
+    apic_write(APIC_TDCR, 0xB);
+    apic_write(APIC_LVTT, APIC_LVT_PERIODIC | LOCAL_TIMER_VECTOR);
+    apic_write(APIC_TMICT, apic_timer_count);
+
+    /* smp_num_cpus大于1之后smp_processor_id()才读APIC，所以最后加. */
+    cpu_online_map |= 1 << cpu;
+    smp_num_cpus++;
+    cpu_callin = 1;
+
+    cpu_idle();
+}
+
+/**
+ * 启动APIC编号为apicid的处理器，启动代码在物理地址start处。为它建立空闲任务(复制
+ * 任务0，不在任务数组中)。空闲任务只在内核中运行，LDT清空，切换到它时不必改动
+ * 处理器的LDT(见__switch_to()).
+ */
+static int boot_cpu(int apicid, unsigned long start)
+{
+    int cpu = smp_num_cpus;
+    struct task_struct *idle;
+
+    if (!(idle = (struct task_struct *)get_free_page()))
+        return 0;
+
+    *idle = *task[0];
+    idle->tss.esp0 = PAGE_SIZE + (long)idle;
+    idle->ldt[1].a = idle->ldt[1].b = 0;
+    idle->ldt[2].a = idle->ldt[2].b = 0;
+    idle->used_math = 0;
+    idle->lock_depth = 0;
+
+    cpu_apicid[cpu] = apicid;
+    apic_to_cpu[apicid] = cpu;
+    ap_idle = idle;
+    ap_stack = PAGE_SIZE + (long)idle;
+    cpu_callin = 0;
+
+    /* INIT(置位后复位)，10ms后发两次STARTUP，处理器从start开始以实模式执行. */
+    send_ipi(apicid, APIC_INT_LEVELTRIG | APIC_INT_ASSERT | APIC_DM_INIT);
+    send_ipi(apicid, APIC_INT_LEVELTRIG | APIC_DM_INIT);
+    wait_ticks((HZ + 99) / 100);
+    send_ipi(apicid, APIC_DM_STARTUP | (start >> 12));
+    wait_ticks(1);
+
+    if (!cpu_callin)
+    {
+        send_ipi(apicid, APIC_DM_STARTUP | (start >> 12));
+        wait_ticks(HZ);
+    }
+
+    if (cpu_callin)
+        return 1;
+
+    printk("SMP: CPU with APIC id %d not responding\n\r", apicid);
+    apic_to_cpu[apicid] = 0;
+    free_page((long)idle);
+
+    return 0;
+}
+
+/**
+ * 启动其它处理器。在main()中开中断之后、进入用户态之前调用.
+ */
+void smp_boot_cpus(void)
+{
+    unsigned long start;
+    int i, bsp;
+
+    if (!mp_nr_cpus || !apic_map())
+        return;
+
+    set_intr_gate(LOCAL_TIMER_VECTOR, &apic_timer_interrupt);
+    set_intr_gate(RESCHEDULE_VECTOR, &reschedule_interrupt);
+    set_intr_gate(INVALIDATE_VECTOR, &invalidate_interrupt);
+    set_intr_gate(SPURIOUS_VECTOR, &spurious_interrupt);
+
+    bsp = apic_read(APIC_ID) >> 24;
+    cpu_apicid[0] = bsp;
+    apic_to_cpu[bsp] = 0;
+    setup_local_apic(1);
+    calibrate_apic_timer();
+
+    /* AP按引导处理器的设置开启分页和4MB页，TS位不要. */
+    __asm__("movl %%cr0,%0" : "=r"(ap_cr0));
+    ap_cr0 &= ~8;
+
+    if (cpu_features & (CPU_PSE | CPU_PGE))
+        __asm__(".byte 0x0f,0x20,0xe0" : "=a"(ap_cr4));   /* movl %cr4,%eax */
+
+    start = PAGE_ALIGN((unsigned long)trampoline_area);
+    memcpy((void *)start, trampoline, trampoline_end - trampoline);
+
+    for (i = 0; i < mp_nr_cpus && smp_num_cpus < NR_CPUS; i++)
+        if (mp_apicid[i] != bsp)
+            boot_cpu(mp_apicid[i], start);
+
+    printk("SMP: %d CPUs online\n\r", smp_num_cpus);
+}
+
+/* 本处理器的TLB需要刷新则刷新，并清除请求位. */
+static void smp_invalidate_poll(int cpu)
+{
+    if (!(smp_invalidate_needed & (1 << cpu)))
+        return;
+
+    __asm__ __volatile__("movl %%cr3,%%eax ; movl %%eax,%%cr3" ::: "ax");
+    __asm__ __volatile__("lock ; btrl %1,%0" ::"m"(smp_invalidate_needed), "r"(cpu) : "memory");
+}
+
+/**
+ * 本处理器修改了页表，让其它处理器刷新TLB并等待它们完成。调用者持有内核大锁，
+ * 其它处理器不在内核中，或者开着中断停机，或者在关中断等待大锁(等待时会查看
+ * smp_invalidate_needed)，所以不会死锁.
+ */
+void smp_flush_tlb(void)
+{
+    unsigned long flags;
+
+    if (smp_num_cpus < 2)
+        return;
+
+    save_flags(flags);
+    cli();
+    smp_invalidate_needed = cpu_online_map & ~(1 << smp_processor_id());
+    send_ipi(0, APIC_DEST_ALLBUT | APIC_DM_FIXED | INVALIDATE_VECTOR);
+
+    while (smp_invalidate_needed)
+        ;
+
+    restore_flags(flags);
+}
+
+/* 刷新TLB的处理器间中断. */
+void smp_invalidate_interrupt(void)
+{
+    smp_invalidate_poll(smp_processor_id());
+    apic_write(APIC_EOI, 0);
+}
+
+/**
+ * 让处理器cpu重新调度。目前只用来唤醒停机中的空闲处理器，中断处理程序本身什么
+ * 也不做.
+ */
+void smp_send_reschedule(int cpu)
+{
+    send_ipi(cpu_apicid[cpu], APIC_DM_FIXED | RESCHEDULE_VECTOR);
+}
+
+void smp_reschedule_interrupt(void)
+{
+    apic_write(APIC_EOI, 0);
+}
+
+/* 本地APIC定时器中断：其它处理器的时钟滴答. 定时器轮等仍由引导处理器处理. */
+void smp_local_timer_interrupt(long cpl)
+{
+    apic_write(APIC_EOI, 0);
+    update_process_times(cpl);
+}
+
+/**
+ * 取得内核大锁。本处理器已经持有则只增加嵌套深度。等待时关着中断，但要响应刷新
+ * TLB的请求.
+ */
+void lock_kernel(void)
+{
+    unsigned long flags;
+    int cpu = smp_processor_id();
+    int busy;
+
+    save_flags(flags);
+    cli();
+
+    if (kernel_lock_owner == cpu)
+    {
+        kernel_lock_depth++;
+        restore_flags(flags);
+        return;
+    }
+
+    for (;;)
+    {
+        __asm__ __volatile__("lock ; btsl $0,%1 ; sbbl %0,%0"
+                             : "=r"(busy) : "m"(kernel_flag) : "memory");
+
+        if (!busy)
+            break;
+
+        while (kernel_flag)
+            smp_invalidate_poll(cpu);
+    }
+
+    kernel_lock_owner = cpu;
+    kernel_lock_depth = 1;
+    restore_flags(flags);
+}
+
+/* 释放一层内核大锁. */
+void unlock_kernel(void)
+{
+    unsigned long flags;
+
+    save_flags(flags);
+    cli();
+
+    if (kernel_lock_owner != smp_processor_id())
+        panic("unlock_kernel: not owner");
+
+    if (!--kernel_lock_depth)
+        release_kernel_lock();
+
+    restore_flags(flags);
+}
+
+/* 完全释放内核大锁，返回原来的嵌套深度。调用时中断已关闭. */
+int release_kernel_lock(void)
+{
+    int depth = kernel_lock_depth;
+
+    kernel_lock_depth = 0;
+    kernel_lock_owner = NO_PROC_ID;
+    __asm__ __volatile__("" ::: "memory");
+    kernel_flag = 0;
+
+    return depth;
+}
+
+/* 重新取得内核大锁并恢复嵌套深度depth. 调用时中断已关闭. */
+void reacquire_kernel_lock(int depth)
+{
+    lock_kernel();
+    kernel_lock_depth = depth;
+}
@@ -234,16 +234,43 @@ int sys_stime(long *tptr)
  */
 int sys_times(struct tms *tbuf)
 {
+    long now = jiffies;
+
     if (tbuf)
     {
         verify_area(tbuf, sizeof *tbuf);
-        put_fs_long(current->utime, (unsigned long *)&tbuf->tms_utime);
-        put_fs_long(current->stime, (unsigned long *)&tbuf->tms_stime);
-        put_fs_long(current->cutime, (unsigned long *)&tbuf->tms_cutime);
-        put_fs_long(current->cstime, (unsigned long *)&tbuf->tms_cstime);
+        put_fs_long(jiffies_to_clock_t(current->utime), (unsigned long *)&tbuf->tms_utime);
+        put_fs_long(jiffies_to_clock_t(current->stime), (unsigned long *)&tbuf->tms_stime);
+        put_fs_long(jiffies_to_clock_t(current->cutime), (unsigned long *)&tbuf->tms_cutime);
+        put_fs_long(jiffies_to_clock_t(current->cstime), (unsigned long *)&tbuf->tms_cstime);
+    }
+
+    return jiffies_to_clock_t(now);
+}
+
+/**
+ * 与times()相同，另外在vbuf中返回当前进程的驻留页数、各种缺页次数、上下文切换次数
+ * 以及系统的总计，用来找出频繁缺页(或频繁切换)的进程.
+ */
+int sys_vtimes(struct tms *tbuf, struct vtms *vbuf)
+{
+    if (vbuf)
+    {
+        verify_area(vbuf, sizeof *vbuf);
+        put_fs_long(current->rss, (unsigned long *)&vbuf->vt_rss);
+        put_fs_long(current->min_flt, (unsigned long *)&vbuf->vt_minflt);
+        put_fs_long(current->maj_flt, (unsigned long *)&vbuf->vt_majflt);
+        put_fs_long(current->cow_flt, (unsigned long *)&vbuf->vt_cowflt);
+        put_fs_long(current->nvcsw, (unsigned long *)&vbuf->vt_nvcsw);
+        put_fs_long(current->nivcsw, (unsigned long *)&vbuf->vt_nivcsw);
+        put_fs_long(total_min_flt, (unsigned long *)&vbuf->vt_total_minflt);
+        put_fs_long(total_maj_flt, (unsigned long *)&vbuf->vt_total_majflt);
+        put_fs_long(total_cow_flt, (unsigned long *)&vbuf->vt_total_cowflt);
+        put_fs_long(nr_free_pages, (unsigned long *)&vbuf->vt_free_pages);
+        put_fs_long(paging_pages, (unsigned long *)&vbuf->vt_pages);
     }
 
-    return jiffies;
+    return sys_times(tbuf);
 }
 
 /**
@@ -255,6 +282,14 @@ int sys_times(struct tms *tbuf)
  */
 int sys_brk(unsigned long end_data_seg)
 {
+    int i;
+
+    /* 数据段不能扩展到文件映射区中. */
+    for (i = 0; i < NR_MMAP; i++)
+        if (current->mmap[i].end && end_data_seg > current->mmap[i].start &&
+            current->brk < current->mmap[i].end)
+            return current->brk;
+
     /* 如果参数>代码结尾，并且小于堆栈-16KB */
     if (end_data_seg >= current->end_code &&
         end_data_seg < current->start_stack - 16384)
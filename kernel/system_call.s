@@ -14,6 +14,11 @@
  * don't handle signal-recognition, as that would clutter them up totally
  * unnecessarily.
  *
+ * 所有进入内核的入口都先取得内核大锁(_lock_kernel，kernel/smp.c)，返回前释放；
+ * 经ret_from_sys_call返回的在那里释放。当前任务是按处理器记录的，用_get_current取.
+ * 返回用户态之前还检查need_resched：有更高优先级的实时任务就绪时要先重新调度(不经
+ * ret_from_sys_call的中断由下一个时钟滴答补上).
+ *
  * Stack layout in 'ret_from_system_call':
  *
  *   0(%esp) - %eax
@@ -51,6 +56,7 @@ priority= 8
 signal  = 12
 sigaction = 16              # MUST be 16 (=len of sigaction)
 blocked = (33*16)
+need_resched = (33*16+4)
 
 # offsets within sigaction
 sa_handler = 0
@@ -58,15 +64,17 @@ sa_mask = 4
 sa_flags = 8
 sa_restorer = 12
 
-nr_system_calls = 72
+nr_system_calls = 84
 
 /*
  * Ok, I get parallel printer interrupts while using the floppy for some
  * strange reason. Urgel. Now I just ignore them.
  */
-.globl _system_call,_sys_fork,_timer_interrupt,_sys_execve
-.globl _hd_interrupt,_floppy_interrupt,_parallel_interrupt
+.globl _system_call,_sys_fork,_sys_vfork,_timer_interrupt,_sys_execve
+.globl _hd_interrupt,_floppy_interrupt,_parallel_interrupt,_rtc_interrupt
 .globl _device_not_available, _coprocessor_error
+.globl _apic_timer_interrupt,_reschedule_interrupt,_invalidate_interrupt
+.globl _spurious_interrupt,_ret_from_fork
 
 .align 2
 bad_sys_call:
@@ -91,21 +99,28 @@ _system_call:
     mov %dx,%es
     movl $0x17,%edx         # fs points to local data space
     mov %dx,%fs
+    pushl %eax
+    call _lock_kernel
+    popl %eax
     call _sys_call_table(,%eax,4)
     pushl %eax
-    movl _current,%eax
+    call _get_current
     cmpl $0,state(%eax)     # state
     jne reschedule
     cmpl $0,counter(%eax)   # counter
     je reschedule
+    cmpl $0,need_resched(%eax)
+    jne reschedule
 ret_from_sys_call:
-    movl _current,%eax      # task[0] cannot have signals
+    call _get_current       # task[0] cannot have signals
     cmpl _task,%eax
     je 3f
     cmpw $0x0f,CS(%esp)     # was old code segment supervisor ?
     jne 3f
     cmpw $0x17,OLDSS(%esp)  # was stack segment = 0x17 ?
     jne 3f
+    cmpl $0,need_resched(%eax)  # preempted by a real-time task ?
+    jne reschedule
     movl signal(%eax),%ebx
     movl blocked(%eax),%ecx
     notl %ecx
@@ -118,7 +133,8 @@ ret_from_sys_call:
     pushl %ecx
     call _do_signal
     popl %eax
-3:  popl %eax
+3:  call _unlock_kernel
+    popl %eax
     popl %ebx
     popl %ecx
     popl %edx
@@ -141,6 +157,7 @@ _coprocessor_error:
     mov %ax,%es
     movl $0x17,%eax
     mov %ax,%fs
+    call _lock_kernel
     pushl $ret_from_sys_call
     jmp _math_error
 
@@ -158,6 +175,7 @@ _device_not_available:
     mov %ax,%es
     movl $0x17,%eax
     mov %ax,%fs
+    call _lock_kernel
     pushl $ret_from_sys_call
     clts                # clear TS so that we can use math
     movl %cr0,%eax
@@ -186,6 +204,7 @@ _timer_interrupt:
     mov %ax,%es
     movl $0x17,%eax
     mov %ax,%fs
+    call _lock_kernel
     incl _jiffies
     movb $0x20,%al      # EOI to interrupt controller #1
     outb %al,$0x20
@@ -196,6 +215,89 @@ _timer_interrupt:
     addl $4,%esp        # task switching to accounting ...
     jmp ret_from_sys_call
 
+/* RTC周期中断(IRQ8)：处理到期的高精度定时器(kernel/hrtimer.c). */
+.align 2
+_rtc_interrupt:
+    push %ds
+    push %es
+    push %fs
+    pushl %edx
+    pushl %ecx
+    pushl %ebx
+    pushl %eax
+    movl $0x10,%eax
+    mov %ax,%ds
+    mov %ax,%es
+    movl $0x17,%eax
+    mov %ax,%fs
+    call _lock_kernel
+    movb $0x20,%al
+    outb %al,$0xA0      # EOI to interrupt controller #2
+    outb %al,$0x20      # EOI to interrupt controller #1
+    movl CS(%esp),%eax
+    andl $3,%eax        # %eax is CPL (0 or 3, 0=supervisor)
+    pushl %eax
+    call _do_rtc_interrupt
+    addl $4,%esp
+    jmp ret_from_sys_call
+
+/* 本地APIC定时器中断：其它处理器的时钟滴答(kernel/smp.c). */
+.align 2
+_apic_timer_interrupt:
+    push %ds
+    push %es
+    push %fs
+    pushl %edx
+    pushl %ecx
+    pushl %ebx
+    pushl %eax
+    movl $0x10,%eax
+    mov %ax,%ds
+    mov %ax,%es
+    movl $0x17,%eax
+    mov %ax,%fs
+    call _lock_kernel
+    movl CS(%esp),%eax
+    andl $3,%eax        # %eax is CPL (0 or 3, 0=supervisor)
+    pushl %eax
+    call _smp_local_timer_interrupt
+    addl $4,%esp
+    jmp ret_from_sys_call
+
+/*
+ * 处理器间中断：重新调度和刷新TLB。不取内核大锁，发送刷新请求的处理器正持有
+ * 大锁在等待.
+ */
+.align 2
+_reschedule_interrupt:
+    pushl $_smp_reschedule_interrupt
+    jmp ipi_common
+
+.align 2
+_invalidate_interrupt:
+    pushl $_smp_invalidate_interrupt
+ipi_common:
+    xchgl %eax,(%esp)
+    pushl %ecx
+    pushl %edx
+    push %ds
+    push %es
+    movl $0x10,%edx
+    mov %dx,%ds
+    mov %dx,%es
+    call *%eax
+    pop %es
+    pop %ds
+    popl %edx
+    popl %ecx
+    popl %eax
+    iret
+
+/* 本地APIC的伪中断不需要EOI. */
+.align 2
+_spurious_interrupt:
+    iret
+
 .align 2
 _sys_execve:
     lea EIP(%esp),%eax
@@ -213,9 +315,39 @@ _sys_fork:
     pushl %esi
     pushl %edi
     pushl %ebp
+    pushl $0
+    pushl %eax
+    call _copy_process
+    addl $24,%esp
+1:  ret
+
+/*
+ * 新任务第一次被切换到时从这里开始(堆栈是copy_process()做好的)：弹出__switch_to()
+ * 的两个参数和切换时保存的寄存器，取得内核大锁，像fork()系统调用一样返回用户态.
+ */
+.align 2
+_ret_from_fork:
+    addl $8,%esp
+    popl %ebp
+    popl %edi
+    popl %esi
+    call _lock_kernel
+    jmp ret_from_sys_call
+
+/* vfork()与fork()相同，只是告诉copy_process()子进程借用父进程的地址空间. */
+.align 2
+_sys_vfork:
+    call _find_empty_process
+    testl %eax,%eax
+    js 1f
+    push %gs
+    pushl %esi
+    pushl %edi
+    pushl %ebp
+    pushl $1
     pushl %eax
     call _copy_process
-    addl $20,%esp
+    addl $24,%esp
 1:  ret
 
 _hd_interrupt:
@@ -230,6 +362,7 @@ _hd_interrupt:
     mov %ax,%es
     movl $0x17,%eax
     mov %ax,%fs
+    call _lock_kernel
     movb $0x20,%al
     outb %al,$0xA0      # EOI to interrupt controller #1
     jmp 1f              # give port chance to breathe
@@ -241,6 +374,7 @@ _hd_interrupt:
     movl $_unexpected_hd_interrupt,%edx
 1:  outb %al,$0x20
     call *%edx          # "interesting" way of handling intr.
+    call _unlock_kernel
     pop %fs
     pop %es
     pop %ds
@@ -261,6 +395,7 @@ _floppy_interrupt:
     mov %ax,%es
     movl $0x17,%eax
     mov %ax,%fs
+    call _lock_kernel
     movb $0x20,%al
     outb %al,$0x20      # EOI to interrupt controller #1
     xorl %eax,%eax
@@ -269,6 +404,7 @@ _floppy_interrupt:
     jne 1f
     movl $_unexpected_floppy_interrupt,%eax
 1:  call *%eax          # "interesting" way of handling intr.
+    call _unlock_kernel
     pop %fs
     pop %es
     pop %ds
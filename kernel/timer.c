@@ -0,0 +1,216 @@
+/*
+ *  linux/kernel/timer.c
+ */
+
+/**
+ * 定时器轮。所有内核定时器(软驱马达、蜂鸣、进程的alarm等)都挂在这里.
+ *
+ * 轮分5级：第1级256个槽，每槽对应一个滴答；第2到5级各64个槽，每槽分别对应
+ * 256、256*64...个滴答，5级合起来覆盖32位的jiffies。定时器按到期时间与timer_jiffies
+ * 之差放入某一级的某个槽(单向链表，带pprev指针)，所以添加和删除都只要常数时间。
+ * 第1级转完一圈时，把第2级下一个槽中的定时器重新分散到第1级(cascade)，依此类推.
+ *
+ * timer_jiffies是下一个要处理的滴答。run_timers()在时钟中断中调用，处理到jiffies
+ * 为止所有到期的定时器.
+ */
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/system.h>
+
+#define TVN_BITS                6
+#define TVR_BITS                8
+#define TVN_SIZE                (1 << TVN_BITS)
+#define TVR_SIZE                (1 << TVR_BITS)
+#define TVN_MASK                (TVN_SIZE - 1)
+#define TVR_MASK                (TVR_SIZE - 1)
+
+static struct timer_list *tv1[TVR_SIZE];
+static struct timer_list *tv2[TVN_SIZE];
+static struct timer_list *tv3[TVN_SIZE];
+static struct timer_list *tv4[TVN_SIZE];
+static struct timer_list *tv5[TVN_SIZE];
+
+static unsigned long timer_jiffies = 0;
+
+/* 第n级(n=2..5)轮的当前槽号. */
+#define INDEX(n)                ((timer_jiffies >> (TVR_BITS + ((n) - 2) * TVN_BITS)) & TVN_MASK)
+
+/* 按到期时间把定时器挂到相应的槽上。调用时中断已关闭. */
+static void internal_add_timer(struct timer_list *timer)
+{
+    unsigned long expires = timer->expires;
+    unsigned long idx = expires - timer_jiffies;
+    struct timer_list **vec;
+
+    if (idx < TVR_SIZE)
+        vec = tv1 + (expires & TVR_MASK);
+    else if (idx < 1 << (TVR_BITS + TVN_BITS))
+        vec = tv2 + ((expires >> TVR_BITS) & TVN_MASK);
+    else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS))
+        vec = tv3 + ((expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK);
+    else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS))
+        vec = tv4 + ((expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK);
+    /* 已经过期的定时器放在马上要处理的槽中. */
+    else if ((long)idx < 0)
+        vec = tv1 + (timer_jiffies & TVR_MASK);
+    else
+        vec = tv5 + ((expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK);
+
+    if (timer->next = *vec)
+        (*vec)->pprev = &timer->next;
+
+    *vec = timer;
+    timer->pprev = vec;
+
+#ifdef NO_HZ_IDLE
+    /**
+     * 定时器轮由引导处理器处理，它空闲时可能停止了时钟滴答，而别的处理器添加的
+     * 定时器可能更早到期，唤醒它重新计算(kernel/sched.c中的tick_idle()).
+     */
+    if (smp_processor_id() && current_set[0] == task[0])
+        smp_send_reschedule(0);
+#endif
+}
+
+/* 把定时器从槽中取下. */
+static void detach_timer(struct timer_list *timer)
+{
+    if (*timer->pprev = timer->next)
+        timer->next->pprev = timer->pprev;
+
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+/**
+ * 添加定时器，到期时刻timer->expires。定时器必须还没有挂上(否则用mod_timer()).
+ * 可以在中断处理程序中调用.
+ */
+void add_timer(struct timer_list *timer)
+{
+    unsigned long flags;
+
+    save_flags(flags);
+    cli();
+
+    if (timer_pending(timer))
+        printk("add_timer: timer already pending\n\r");
+    else
+        internal_add_timer(timer);
+
+    restore_flags(flags);
+}
+
+/**
+ * 删除定时器。定时器原来挂着则返回1，否则(已经到期或没有添加过)返回0.
+ */
+int del_timer(struct timer_list *timer)
+{
+    unsigned long flags;
+    int ret = 0;
+
+    save_flags(flags);
+    cli();
+
+    if (timer_pending(timer))
+    {
+        detach_timer(timer);
+        ret = 1;
+    }
+
+    restore_flags(flags);
+
+    return ret;
+}
+
+/**
+ * 把定时器的到期时刻改为expires，定时器没有挂上则挂上。返回值同del_timer().
+ */
+int mod_timer(struct timer_list *timer, unsigned long expires)
+{
+    unsigned long flags;
+    int ret = 0;
+
+    save_flags(flags);
+    cli();
+
+    if (timer_pending(timer))
+    {
+        detach_timer(timer);
+        ret = 1;
+    }
+
+    timer->expires = expires;
+    internal_add_timer(timer);
+    restore_flags(flags);
+
+    return ret;
+}
+
+/**
+ * 空闲时停止时钟滴答用：返回下一次必须有时钟中断的滴答距现在(jiffies)有多少个
+ * 滴答，最多max个。在此之前的滴答上既没有定时器到期，也不需要从高级轮中取定时器.
+ */
+long timer_idle_ticks(long max)
+{
+    unsigned long j = timer_jiffies;
+    long ticks;
+
+    /* 还有没处理完的滴答. */
+    if ((long)(jiffies - timer_jiffies) >= 0)
+        return 1;
+
+    for (ticks = 1; ticks < max; ticks++, j++)
+        if (tv1[j & TVR_MASK] || !(j & TVR_MASK))
+            break;
+
+    return ticks;
+}
+
+/* 把高一级轮vec中第index槽的定时器重新分散到低级轮中，返回index. */
+static int cascade(struct timer_list **vec, int index)
+{
+    struct timer_list *timer, *next;
+
+    timer = vec[index];
+    vec[index] = NULL;
+
+    for (; timer; timer = next)
+    {
+        next = timer->next;
+        internal_add_timer(timer);
+    }
+
+    return index;
+}
+
+/**
+ * 处理所有已到期的定时器。由do_timer()在时钟中断中调用(中断已关闭)，处理函数
+ * 也在关中断的情况下执行，所以应尽量简短.
+ */
+void run_timers(void)
+{
+    struct timer_list *timer;
+    int index;
+
+    while ((long)(jiffies - timer_jiffies) >= 0)
+    {
+        index = timer_jiffies & TVR_MASK;
+
+        /* 第1级转完一圈，从高级轮中取下一批定时器. */
+        if (!index &&
+            !cascade(tv2, INDEX(2)) &&
+            !cascade(tv3, INDEX(3)) &&
+            !cascade(tv4, INDEX(4)))
+            cascade(tv5, INDEX(5));
+
+        while (timer = tv1[index])
+        {
+            detach_timer(timer);
+            timer->function(timer->data);
+        }
+
+        timer_jiffies++;
+    }
+}
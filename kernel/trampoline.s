@@ -0,0 +1,64 @@
+/*
+ *  linux/kernel/trampoline.s
+ */
+
+/*
+ * 其它处理器(AP)的启动代码(见kernel/smp.c)。smp_boot_cpus()把_trampoline到
+ * _trampoline_end之间的代码复制到1MB以下某页的开始处，AP收到STARTUP处理器间中断
+ * 后从该页(cs=页地址>>4，ip=0)以实模式开始执行：加载内核的GDT，进入保护模式并
+ * 跳到startup_32_smp。实模式部分gas不能汇编，直接写出机器码，其中的偏移都相对于
+ * _trampoline，所以复制到哪一页都可以.
+ *
+ * startup_32_smp按引导处理器保存的ap_cr4、ap_cr0开启4MB页和分页(页目录在0处)，
+ * 在ap_stack(空闲任务的内核堆栈)上调用smp_callin()，后者不再返回.
+ */
+
+.globl _trampoline,_trampoline_end
+
+.text
+.align 2
+_trampoline:
+    .byte 0xfa                  /* cli */
+    .byte 0x8c,0xc8             /* movw %cs,%ax */
+    .byte 0x8e,0xd8             /* movw %ax,%ds */
+    .byte 0x0f,0x01,0x16        /* lgdt tramp_gdt_descr */
+    .word tramp_gdt_descr - _trampoline
+    .byte 0xb8,0x01,0x00        /* movw $1,%ax */
+    .byte 0x0f,0x01,0xf0        /* lmsw %ax (PE) */
+    .byte 0x66,0xea             /* ljmpl $8,$startup_32_smp */
+    .long startup_32_smp
+    .word 0x08
+.align 2
+.word 0
+tramp_gdt_descr:                /* 实模式下lgdt只用基址的低24位，GDT在16MB以下. */
+    .word 256*8-1
+    .long _gdt
+_trampoline_end:
+
+.align 2
+startup_32_smp:
+    movl $0x10,%eax
+    mov %ax,%ds
+    mov %ax,%es
+    mov %ax,%fs
+    mov %ax,%gs
+    mov %ax,%ss
+    movl _ap_stack,%esp
+    movl _ap_cr4,%eax
+    testl %eax,%eax
+    je 1f
+    .byte 0x0f,0x22,0xe0        /* movl %eax,%cr4 */
+1:  xorl %eax,%eax              /* pg_dir is at 0x0000 */
+    movl %eax,%cr3
+    movl _ap_cr0,%eax           /* PG and math bits as on the boot cpu */
+    movl %eax,%cr0
+    jmp 1f                      /* flush prefetch-queue */
+1:  lidt ap_idt_descr
+    call _smp_callin
+2:  jmp 2b
+
+.align 2
+.word 0
+ap_idt_descr:
+    .word 256*8-1
+    .long _idt
@@ -78,8 +78,7 @@ static void die(char *str, long esp_ptr, long nr)
         printk("\n");
     }
 
-    str(i);
-    printk("Pid: %d, process nr: %d\n\r", current->pid, 0xffff & i);
+    printk("Pid: %d, cpu: %d\n\r", current->pid, current->processor);
 
     for (i = 0; i < 10; i++)
         printk("%02x ", 0xff & get_seg_byte(esp[1], (i + (char *)esp[0])));
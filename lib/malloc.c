@@ -97,23 +97,13 @@ struct bucket_desc *free_bucket_desc = (struct bucket_desc *)0;
  */
 
 /**
- * 初始化桶描述符。
- * 建立空闲桶描述符链表，并让free_bucket_desc指向第一个空闲桶描述符.
+ * 把first开始的一页内存分成桶描述符，加入空闲桶描述符链表.
  */
-static inline void init_bucket_desc()
+static inline void link_bucket_desc(struct bucket_desc *first)
 {
-    struct bucket_desc *bdesc, *first;
+    struct bucket_desc *bdesc = first;
     int i;
 
-    /**
-     * 申请一页内存，用于存放桶描述符。如果失败，则显示初始化桶描述符时
-     * 内存不够出错信息，死机.
-     */
-    first = bdesc = (struct bucket_desc *)get_free_page();
-
-    if (!bdesc)
-        panic("Out of memory in init_bucket_desc()");
-
     /* 首先计算一页内存中可存放的桶描述符数量，然后对其建立单向连接指针. */
     for (i = PAGE_SIZE / sizeof(struct bucket_desc); i > 1; i--)
     {
@@ -130,6 +120,26 @@ static inline void init_bucket_desc()
     free_bucket_desc = first;
 }
 
+/**
+ * 初始化桶描述符。
+ * 建立空闲桶描述符链表，并让free_bucket_desc指向第一个空闲桶描述符.
+ */
+static inline void init_bucket_desc()
+{
+    struct bucket_desc *first;
+
+    /**
+     * 申请一页内存，用于存放桶描述符。如果失败，则显示初始化桶描述符时
+     * 内存不够出错信息，死机.
+     */
+    first = (struct bucket_desc *)get_free_page();
+
+    if (!first)
+        panic("Out of memory in init_bucket_desc()");
+
+    link_bucket_desc(first);
+}
+
 /**
  * 分配动态内存函数。
  * 参数：len - 请求的内存块长度。
@@ -140,6 +150,7 @@ void *malloc(unsigned int len)
     struct _bucket_dir *bdir;
     struct bucket_desc *bdesc;
     void *retval;
+    unsigned long flags;
 
     /**
      * 首先我们搜索存储桶目录bucket_dir来寻找适合请求的桶大小.
@@ -166,6 +177,7 @@ void *malloc(unsigned int len)
     /**
      * 现在我们来搜索具有空闲空间的桶描述符.
      */
+    save_flags(flags);
     cli(); /* 为了避免出现竞争条件，首先关中断. */
 
     /**
@@ -237,8 +249,8 @@ void *malloc(unsigned int len)
     bdesc->freeptr = *((void **)retval);
     bdesc->refcnt++;
 
-    /* 最后开放中断，并返回指向空闲内存对象的指针. */
-    sti(); /* OK, 现在我们又安全了. */
+    /* 最后恢复中断状态(在中断处理程序中调用时不能开中断)，并返回指向空闲内存对象的指针. */
+    restore_flags(flags); /* OK, 现在我们又安全了. */
 
     return (retval);
 }
@@ -258,6 +270,7 @@ void free_s(void *obj, int size)
     void *page;
     struct _bucket_dir *bdir;
     struct bucket_desc *bdesc, *prev;
+    unsigned long flags;
 
     /* 计算该对象所在的页面. */
     page = (void *)((unsigned long)obj & 0xfffff000);
@@ -288,6 +301,7 @@ void free_s(void *obj, int size)
     panic("Bad address passed to kernel free_s()");
 
 found:
+    save_flags(flags);
     cli(); /* 关中断，为了避免竞争条件. */
 
     *((void **)obj) = bdesc->freeptr;
@@ -331,8 +345,265 @@ found:
         free_bucket_desc = bdesc;
     }
 
-    /* 开中断. */
-    sti();
+    /* 恢复中断状态. */
+    restore_flags(flags);
 
     return;
 }
+
+/*
+ * 对象缓存(slab)。每个缓存管理一种固定大小的对象(文件结构、定时器等)，对象放在
+ * 从get_free_page()取得的页面中，每页由一个桶描述符管理，与上面的存储桶相同。
+ * 不同之处在于：
+ *
+ * 页面中只放同一类型的对象，对象大小不必是2的幂，所以页面利用率高;
+ *
+ * 可以指定构造函数，在对象所在页面建立时对每个对象调用一次。空闲链表指针放在
+ * 对象之后，不会破坏对象的内容，所以释放的对象应保持构造后的状态，再分配时就
+ * 不必重新初始化;
+ *
+ * 对象全部释放后页面并不马上归还，而是在内存不够时由kmem_shrink()回收，同时回收
+ * 全部空闲的桶描述符页面。每个缓存总保留一个空页面，这样在中断处理程序中分配
+ * 对象时通常不必申请页面.
+ *
+ * 分配和释放都可以在中断处理程序中调用(只要不需要申请新页面)，所以不能简单地
+ * 用cli()/sti()，而要保存和恢复标志寄存器.
+ */
+struct kmem_cache
+{
+    const char *name;               /* 缓存名称，用于出错信息. */
+    int size;                       /* 对象大小(按4字节对齐). */
+    int objsize;                    /* 对象大小加上空闲链表指针. */
+    void (*ctor)(void *obj);        /* 构造函数，可以为NULL. */
+    struct bucket_desc *chain;      /* 该缓存各页面的桶描述符链表. */
+    struct kmem_cache *next;        /* 所有缓存链成一个链表. */
+};
+
+static struct kmem_cache *cache_chain = (struct kmem_cache *)0;
+
+/* 空闲对象的链表指针，放在对象之后. */
+#define FREE_LINK(cachep, obj)  (*(void **)((char *)(obj) + (cachep)->size))
+
+/**
+ * 建立一个对象缓存。参数：name - 名称；size - 对象大小；ctor - 构造函数(可为NULL).
+ */
+struct kmem_cache *kmem_cache_create(const char *name, int size, void (*ctor)(void *))
+{
+    struct kmem_cache *cachep;
+
+    size = (size + 3) & ~3;
+
+    if (size <= 0 || size + sizeof(void *) > PAGE_SIZE)
+        panic("kmem_cache_create: bad object size");
+
+    cachep = (struct kmem_cache *)malloc(sizeof(struct kmem_cache));
+    cachep->name = name;
+    cachep->size = size;
+    cachep->objsize = size + sizeof(void *);
+    cachep->ctor = ctor;
+    cachep->chain = (struct bucket_desc *)0;
+    cachep->next = cache_chain;
+    cache_chain = cachep;
+
+    return cachep;
+}
+
+/**
+ * 为缓存增加一个页面：取一个空闲桶描述符和一页内存，对页中每个对象调用构造函数
+ * 并建立空闲链表。内存不够时返回NULL。调用时中断已关闭.
+ *
+ * 可能是在中断处理程序中调用的，所以页面(包括桶描述符页面)只用get_free_page_atomic()
+ * 取，不换出页面也不睡眠.
+ */
+static struct bucket_desc *kmem_cache_grow(struct kmem_cache *cachep)
+{
+    struct bucket_desc *bdesc;
+    char *cp;
+    int i;
+
+    if (!free_bucket_desc)
+    {
+        if (!(bdesc = (struct bucket_desc *)get_free_page_atomic()))
+            return (struct bucket_desc *)0;
+
+        link_bucket_desc(bdesc);
+    }
+
+    bdesc = free_bucket_desc;
+    free_bucket_desc = bdesc->next;
+
+    if (!(cp = (char *)get_free_page_atomic()))
+    {
+        bdesc->next = free_bucket_desc;
+        free_bucket_desc = bdesc;
+        return (struct bucket_desc *)0;
+    }
+
+    bdesc->refcnt = 0;
+    bdesc->bucket_size = cachep->objsize;
+    bdesc->page = bdesc->freeptr = cp;
+
+    for (i = PAGE_SIZE / cachep->objsize; i > 0; i--, cp += cachep->objsize)
+    {
+        if (cachep->ctor)
+            cachep->ctor(cp);
+
+        FREE_LINK(cachep, cp) = (i > 1) ? cp + cachep->objsize : (char *)0;
+    }
+
+    bdesc->next = cachep->chain;
+    cachep->chain = bdesc;
+
+    return bdesc;
+}
+
+/**
+ * 从缓存中分配一个对象(处于构造后的状态)。内存不够时返回NULL.
+ */
+void *kmem_cache_alloc(struct kmem_cache *cachep)
+{
+    struct bucket_desc *bdesc;
+    unsigned long flags;
+    void *retval;
+
+    save_flags(flags);
+    cli();
+
+    for (bdesc = cachep->chain; bdesc; bdesc = bdesc->next)
+        if (bdesc->freeptr)
+            break;
+
+    if (!bdesc && !(bdesc = kmem_cache_grow(cachep)))
+    {
+        restore_flags(flags);
+        return (void *)0;
+    }
+
+    retval = bdesc->freeptr;
+    bdesc->freeptr = FREE_LINK(cachep, retval);
+    bdesc->refcnt++;
+    restore_flags(flags);
+
+    return retval;
+}
+
+/**
+ * 把对象obj还给缓存。页面即使全空了也不马上释放，见kmem_cache_shrink().
+ */
+void kmem_cache_free(struct kmem_cache *cachep, void *obj)
+{
+    struct bucket_desc *bdesc;
+    unsigned long flags;
+    void *page;
+
+    page = (void *)((unsigned long)obj & 0xfffff000);
+    save_flags(flags);
+    cli();
+
+    for (bdesc = cachep->chain; bdesc; bdesc = bdesc->next)
+        if (bdesc->page == page)
+            break;
+
+    if (!bdesc)
+    {
+        printk("kmem_cache_free: %s\n", cachep->name);
+        panic("Bad address passed to kernel kmem_cache_free()");
+    }
+
+    FREE_LINK(cachep, obj) = bdesc->freeptr;
+    bdesc->freeptr = obj;
+    bdesc->refcnt--;
+    restore_flags(flags);
+}
+
+/**
+ * 释放缓存中没有对象在用的页面(保留一个)，返回释放的页面数.
+ */
+int kmem_cache_shrink(struct kmem_cache *cachep)
+{
+    struct bucket_desc *bdesc, **pp;
+    unsigned long flags;
+    int kept = 0, freed = 0;
+
+    save_flags(flags);
+    cli();
+
+    for (pp = &cachep->chain; bdesc = *pp;)
+    {
+        if (bdesc->refcnt || !kept++)
+        {
+            pp = &bdesc->next;
+            continue;
+        }
+
+        *pp = bdesc->next;
+        free_page((unsigned long)bdesc->page);
+        bdesc->next = free_bucket_desc;
+        free_bucket_desc = bdesc;
+        freed++;
+    }
+
+    restore_flags(flags);
+
+    return freed;
+}
+
+/**
+ * 释放所有描述符都空闲的桶描述符页面，返回释放的页面数。每页描述符是由
+ * init_bucket_desc()一次建立的，第一个描述符就在页面开始处。调用时中断已关闭.
+ */
+static int shrink_bucket_desc(void)
+{
+    struct bucket_desc *bdesc, *p, **pp;
+    unsigned long page;
+    int n, freed = 0;
+
+repeat:
+    for (bdesc = free_bucket_desc; bdesc; bdesc = bdesc->next)
+    {
+        page = (unsigned long)bdesc;
+
+        if (page & 0xfff)
+            continue;
+
+        for (n = 0, p = free_bucket_desc; p; p = p->next)
+            if (((unsigned long)p & 0xfffff000) == page)
+                n++;
+
+        if (n < PAGE_SIZE / sizeof(struct bucket_desc))
+            continue;
+
+        for (pp = &free_bucket_desc; p = *pp;)
+            if (((unsigned long)p & 0xfffff000) == page)
+                *pp = p->next;
+            else
+                pp = &p->next;
+
+        free_page(page);
+        freed++;
+        goto repeat;
+    }
+
+    return freed;
+}
+
+/**
+ * 内存不够时调用(mm/memory.c)：回收所有缓存的空页面以及空闲的桶描述符页面.
+ * 释放了页面返回1.
+ */
+int kmem_shrink(void)
+{
+    struct kmem_cache *cachep;
+    unsigned long flags;
+    int freed = 0;
+
+    for (cachep = cache_chain; cachep; cachep = cachep->next)
+        freed += kmem_cache_shrink(cachep);
+
+    save_flags(flags);
+    cli();
+    freed += shrink_bucket_desc();
+    restore_flags(flags);
+
+    return freed != 0;
+}
@@ -0,0 +1,44 @@
+/*
+ *  linux/lib/mmap.c
+ */
+
+#define __LIBRARY__
+#include <unistd.h>
+#include <sys/mman.h>
+
+/**
+ * 文件映射函数。
+ * 系统调用最多只能带3个参数，所以把6个参数放在mmap_arg_struct结构中，只把结构的
+ * 地址传给内核.
+ * 返回：映射区地址，若出错则置出错码，并返回MAP_FAILED.
+ */
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset)
+{
+    struct mmap_arg_struct arg;
+    register long res;
+
+    arg.addr = (unsigned long)addr;
+    arg.len = len;
+    arg.prot = prot;
+    arg.flags = flags;
+    arg.fd = fd;
+    arg.offset = offset;
+
+    __asm__("int $0x80"
+            : "=a"(res)
+            : "0"(__NR_mmap), "b"(&arg));
+
+    /* 映射区地址都小于64MB，负值是出错码. */
+    if (res >= 0)
+        return (void *)res;
+
+    errno = -res;
+
+    return MAP_FAILED;
+}
+
+/**
+ * 解除映射函数。
+ * 下面系统调用宏对应于函数：int munmap(void *addr, size_t len)。
+ */
+_syscall2(int, munmap, void *, addr, size_t, len)
@@ -20,6 +20,7 @@
  */
 
 #include <signal.h>
+#include <string.h>
 
 #include <asm/system.h>
 
@@ -30,8 +31,10 @@
 /* 进程退出处理函数，在kernel/exit.c. */
 volatile void do_exit(long code);
 
+void do_no_page(unsigned long error_code, unsigned long address);
+
 /* 显示内存已用完出错信息，并退出. */
-static inline volatile void oom(void)
+volatile void oom(void)
 {
     printk("out of memory\n\r");
 
@@ -42,83 +45,465 @@ static inline volatile void oom(void)
     do_exit(SIGSEGV);
 }
 
+/* 整数平方根，用于oom_badness()中对运行时间的折算. */
+static unsigned long int_sqrt(unsigned long x)
+{
+    unsigned long r = 0;
+
+    while ((r + 1) * (r + 1) <= x)
+        r++;
+
+    return r;
+}
+
 /**
- * 刷新页变换高速缓冲宏函数。
- * 为了提高地址转换的效率，CPU 将最近使用的页表数据存放在芯片中高速缓冲中。
- * 在修改过页表信息之后，就需要刷新该缓冲区。这里使用重新加载页目录基址寄存器
- * cr3 的方法来进行刷新,下面eax = 0，是页目录的基址.
+ * 统计任务p在物理内存中驻留的页面数(不包括已换出的页面)。只数其64MB线性空间
+ * 中存在的页面，与其它进程共享的页面也计算在内.
  */
-#define invalidate() \
-    __asm__("movl %%eax,%%cr3" ::"a"(0))
+static unsigned long resident_pages(struct task_struct *p)
+{
+    unsigned long *dir, *pg_table;
+    unsigned long count = 0;
+    int i, j;
+
+    dir = (unsigned long *)((p->start_code >> 20) & 0xffc);
+
+    for (i = 0; i < 16; i++, dir++)
+    {
+        if (!(1 & *dir))
+            continue;
+
+        pg_table = (unsigned long *)(0xfffff000 & *dir);
+
+        for (j = 0; j < 1024; j++)
+            if (1 & pg_table[j])
+                count++;
+    }
+
+    return count;
+}
+
+/**
+ * 计算任务p的"坏度"分值，内存耗尽时分值最高的任务被杀死。基本分值是驻留页面数，
+ * 这样首先被选中的是占用内存最多的进程。已运行了较长时间(cpu时间和存活时间)的
+ * 进程多半是有用的长期服务进程，分值按时间的平方根降低；被降低了优先级(nice)的
+ * 进程本来就不重要，分值加倍；超级用户的进程通常比较重要，分值除以4.
+ */
+static unsigned long oom_badness(struct task_struct *p)
+{
+    unsigned long points, cpu_time, run_time;
+
+    /* vfork()的子进程用的是父进程的内存，杀死它并不能释放内存. */
+    if (p->vfork_parent)
+        return 0;
+
+    if (!(points = resident_pages(p)))
+        return 0;
+
+    /* 以10秒为单位. */
+    cpu_time = (p->utime + p->stime) / (HZ * 10);
+    run_time = (jiffies - p->start_time) / (HZ * 10);
+
+    if (cpu_time)
+        points /= int_sqrt(cpu_time) + 1;
+
+    if (run_time)
+        points /= int_sqrt(int_sqrt(run_time)) + 1;
+
+    if (p->priority < DEF_PRIORITY)
+        points <<= 1;
+
+    if (!p->euid)
+        points >>= 2;
+
+    return points ? points : 1;
+}
+
+/**
+ * 内存耗尽时选择一个分值最高的任务并向其发送SIGKILL。任务0和init进程(任务1)
+ * 永远不会被选中。被选中的进程在退出时(do_exit)释放其内存，调用者应让出CPU后再
+ * 重新尝试分配。若已经有进程在被杀死的过程中，则不再选新的牺牲者，只是等待它退出.
+ * 返回值：选中的任务不是当前进程时返回1，否则返回0(由调用者自行处理当前进程).
+ */
+static int oom_kill(void)
+{
+    struct task_struct **p, *victim = NULL;
+    unsigned long points, max_points = 0;
+
+    for (p = &LAST_TASK; p > &task[1]; --p)
+    {
+        if (!*p || (*p)->state == TASK_ZOMBIE)
+            continue;
+
+        /* 已有正在被杀死的进程，等它退出释放内存即可. */
+        if ((*p)->signal & (1 << (SIGKILL - 1)))
+            return *p != current;
+
+        if ((points = oom_badness(*p)) > max_points)
+        {
+            max_points = points;
+            victim = *p;
+        }
+    }
+
+    if (!victim || victim == current)
+        return 0;
+
+    printk("Out of memory: killed process %d (score %d)\n\r",
+           victim->pid, max_points);
+
+    victim->signal |= 1 << (SIGKILL - 1);
+
+    signal_wake_up(victim);
+
+    return 1;
+}
+
+/**
+ * 预先清零的空闲页面池。任务0空闲时(见sys_pause())把空闲页面清零后放到这里，
+ * get_free_page()先从这里取，这样缺页和fork()时就不必花时间清零了。池中页面的
+ * 引用计数为1，不算在nr_free_pages中；只在空闲页面多于全部分页内存的1/ZERO_POOL_FREE
+ * 时才填充，内存不够时最先归还.
+ */
+#define ZERO_POOL_PAGES         32
+#define ZERO_POOL_FREE          8
+
+static unsigned long zero_pool[ZERO_POOL_PAGES];
+static int zero_pool_nr = 0;
+
+/* 把池中的一个页面还给伙伴系统。池空返回0. */
+static int shrink_zero_pool(void)
+{
+    if (!zero_pool_nr)
+        return 0;
+
+    free_page(zero_pool[--zero_pool_nr]);
+
+    return 1;
+}
 
 /**
- * 下面定义若需要改动，则需要与head.s等文件中的相关信息一起改变.
- * linux 0.11内核默认支持的最大内存容量是16M，可以修改这些定义以适合更多的内存.
+ * 回收内存：先释放可回收的缓存页面，再换出进程页面。能腾出一页时返回1.
+ * 
+ * 高速缓冲区是启动时划出的固定区域，并不从这里分配，所以没有可归还的页面。
+ * 预先清零的页面和内核对象缓存(lib/malloc.c)中的空页面最容易归还，最先释放。
+ * 执行文件页面缓存中没有进程在用的页面最先被释放。进程中干净的页面在swap_out()中
+ * 会被直接丢弃(需要时重新从文件读入)，所以即使没有交换空间，swap_out()也能腾出
+ * 这类页面.
  */
-/* 内存低端(1MB). */
-#define LOW_MEM                 0x100000
-/* 分页内存15MB。主内存区最多15M. */
-#define PAGING_MEMORY           (15 * 1024 * 1024)
-/* 分页后的物理内存页数. */
-#define PAGING_PAGES            (PAGING_MEMORY >> 12)
-/* 指定内存地址映射为页号. */
-#define MAP_NR(addr)            (((addr)-LOW_MEM) >> 12)
-/* 页面被占用标志. */
-#define USED                    100
+static int try_to_free_pages(void)
+{
+    return shrink_zero_pool() || kmem_shrink() || shrink_page_cache() || swap_out();
+}
 
 /* 该宏用于判断给定地址是否位于当前进程的代码段中. */
 #define CODE_SPACE(addr) ((((addr) + 4095) & ~4095) < \
                           current->start_code + current->end_code)
 
 /* 全局变量，存放实际物理内存最高端地址. */
-static long HIGH_MEMORY = 0;
+unsigned long HIGH_MEMORY = 0;
+
+/* 实际可分页的物理内存页数. */
+long paging_pages = 0;
 
 /* 复制1页内存(4K字节). */
 #define copy_page(from, to)                                     \
     __asm__("cld ; rep ; movsl" ::"S"(from), "D"(to), "c"(1024) \
             : "cx", "di", "si")
 
-/* 内存映射字节图(1字节代表1页内存)，每个页面对应的字节用于标志页面当前被引用(占用)次数. */
-static unsigned char mem_map[PAGING_PAGES] = {
-    0,
+/**
+ * 内存映射字节图(1字节代表1页内存)，每个页面对应的字节用于标志页面当前被引用(占用)次数.
+ * 数组大小取决于实际内存容量，由paging_init()在主内存区开始处分配.
+ */
+unsigned char *mem_map = NULL;
+
+/**
+ * 伙伴(buddy)系统空闲链表。
+ * 空闲内存按2的幂次页面数组织成块，阶数为order的块含有(1 << order)个连续页面，
+ * 且其起始页号(相对LOW_MEM)按块大小对齐。每个阶数有一个双向空闲链表，链表节点
+ * 直接存放在空闲块首页面的开始处(主内存区在内核中是恒等映射的，可直接访问).
+ * 最大阶数的块为32页(128KB)，不会跨越64KB的DMA边界的块最多是16页.
+ */
+#define NR_ORDERS               6
+
+struct free_block
+{
+    struct free_block *next;
+    struct free_block *prev;
+};
+
+/* 各阶空闲块链表头. */
+static struct free_block *free_area[NR_ORDERS] = {
+    NULL,
 };
 
 /**
- * 获取首个(实际上是最后1个:-)空闲页面，并标记为已使用，
- * 如果没有空闲页面，就返回0.
+ * 空闲块首页标志图：若该页是阶数为order的空闲块的首页，则对应字节为order+1，否则为0.
+ * 与mem_map[]一样由paging_init()分配.
+ */
+static unsigned char *page_order = NULL;
+
+/* 当前空闲页面总数. */
+long nr_free_pages = 0;
+
+/* 系统的缺页总计(见count_fault()). */
+long total_min_flt = 0, total_maj_flt = 0, total_cow_flt = 0;
+
+/* 页号与空闲块指针之间的转换. */
+#define BLOCK_ADDR(nr)          ((struct free_block *)(LOW_MEM + ((nr) << 12)))
+#define BLOCK_NR(block)         MAP_NR((unsigned long)(block))
+
+/* 将页号为nr、阶数为order的块插入对应空闲链表头. */
+static inline void add_free_block(unsigned long nr, int order)
+{
+    struct free_block *block = BLOCK_ADDR(nr);
+
+    block->prev = NULL;
+    block->next = free_area[order];
+
+    if (block->next)
+        block->next->prev = block;
+
+    free_area[order] = block;
+    page_order[nr] = order + 1;
+}
+
+/* 从阶数为order的空闲链表中摘下页号为nr的块. */
+static inline void del_free_block(unsigned long nr, int order)
+{
+    struct free_block *block = BLOCK_ADDR(nr);
+
+    if (block->prev)
+        block->prev->next = block->next;
+    else
+        free_area[order] = block->next;
+
+    if (block->next)
+        block->next->prev = block->prev;
+
+    page_order[nr] = 0;
+}
+
+/**
+ * 将页号为nr、阶数为order的块放回伙伴系统。
+ * 只要其伙伴块(页号为nr ^ (1 << order))也是同阶的空闲块，就把两者合并成高一阶的块，
+ * 直到不能再合并或达到最大阶数为止.
+ */
+static void free_pages_ok(unsigned long nr, int order)
+{
+    unsigned long buddy;
+
+    nr_free_pages += 1 << order;
+
+    while (order < NR_ORDERS - 1)
+    {
+        buddy = nr ^ (1 << order);
+
+        if (buddy >= PAGING_PAGES || page_order[buddy] != order + 1)
+            break;
+
+        del_free_block(buddy, order);
+        nr &= ~(1 << order);
+        order++;
+    }
+
+    add_free_block(nr, order);
+}
+
+/* 内存耗尽时，等待被杀死的进程退出的最多重试次数. */
+#define OOM_RETRIES 20
+
+/* 将从addr开始的n个页面(n*4K字节)清零. */
+#define zero_pages(addr, n)                                      \
+    __asm__("cld ; rep ; stosl" ::"a"(0), "D"(addr), "c"((n) << 10) \
+            : "cx", "di")
+
+/**
+ * 取得物理上连续的(1 << order)个空闲页面，并将每页的引用计数置1(内容不清零).
+ * 若没有足够大的空闲块，则返回0.
+ *
+ * 先在阶数为order的空闲链表中找，若为空则依次向高阶链表找。从高阶链表取得的块
+ * 被对半分割，不用的一半放回低一阶的链表中。因此单页面分配只是一次链表摘除操作，
+ * 与主内存区的大小以及已用页面的多少无关.
+ * 返回块的起始地址按块大小对齐.
+ *
+ * 单页面分配时若已没有空闲页面，则先回收内存(换出一页)后再试；仍然不行就按坏度
+ * 分值杀死一个进程，等它释放内存后再试。注意这可能会睡眠或让出CPU，所以wait为0
+ * 时(中断处理程序中)不回收，直接返回0.
+ */
+static unsigned long alloc_pages(int order, int wait)
+{
+    struct free_block *block;
+    unsigned long nr;
+    int i, oom_retries = 0;
+
+    if (order < 0 || order >= NR_ORDERS)
+        return 0;
+
+repeat:
+    for (i = order; i < NR_ORDERS; i++)
+        if (free_area[i])
+            break;
+
+    if (i >= NR_ORDERS)
+    {
+        if (order || !wait)
+            return 0;
+
+        if (try_to_free_pages())
+            goto repeat;
+
+        /* 杀死一个进程后让出CPU，让它有机会退出并释放内存，然后再试. */
+        if (current != task[0] && oom_kill() && oom_retries++ < OOM_RETRIES)
+        {
+            current->counter = 0;
+            schedule();
+            goto repeat;
+        }
+
+        return 0;
+    }
+
+    block = free_area[i];
+    nr = BLOCK_NR(block);
+    del_free_block(nr, i);
+
+    /* 把多余的后半部分依次放回低阶链表. */
+    while (i > order)
+    {
+        i--;
+        add_free_block(nr + (1 << i), i);
+    }
+
+    nr_free_pages -= 1 << order;
+
+    /* 块中每个页面单独计数，这样写时复制和free_page()都能按页处理. */
+    for (i = 0; i < (1 << order); i++)
+        mem_map[nr + i] = 1;
+
+    return LOW_MEM + (nr << 12);
+}
+
+/**
+ * 取得物理上连续的(1 << order)个空闲页面，页面内容清零。见alloc_pages().
+ */
+unsigned long get_free_pages(int order)
+{
+    unsigned long addr;
+
+    if (addr = alloc_pages(order, 1))
+        zero_pages(addr, 1 << order);
+
+    return addr;
+}
+
+/**
+ * 待刷新TLB项的线性地址。fork()和exit()一次要修改很多页表项，先把地址记在这里，最后
+ * 由flush_tlb_batch()统一刷新：不超过INVLPG_MAX页时逐页invlpg，否则重新加载cr3.
+ */
+static unsigned long tlb_batch[INVLPG_MAX];
+static int tlb_batch_nr = 0;
+
+static inline void tlb_batch_add(unsigned long address)
+{
+    if (tlb_batch_nr < INVLPG_MAX)
+        tlb_batch[tlb_batch_nr] = address;
+
+    tlb_batch_nr++;
+}
+
+static void flush_tlb_batch(void)
+{
+    int i;
+
+    if (tlb_batch_nr > INVLPG_MAX || x86 < 4)
+        __invalidate();
+    else
+        for (i = 0; i < tlb_batch_nr; i++)
+            __invalidate_page(tlb_batch[i]);
+
+    /* 其它处理器只通知一次. */
+    if (tlb_batch_nr)
+        smp_flush_tlb();
+
+    tlb_batch_nr = 0;
+}
+
+/**
+ * 刷新线性地址[start, end)内各页的TLB项.
+ */
+void invalidate_range(unsigned long start, unsigned long end)
+{
+    start &= 0xfffff000;
+
+    if (x86 < 4 || end - start > INVLPG_MAX * PAGE_SIZE)
+    {
+        invalidate();
+        return;
+    }
+
+    for (; start < end; start += PAGE_SIZE)
+        __invalidate_page(start);
+
+    smp_flush_tlb();
+}
+
+/**
+ * 获取1个空闲页面，并标记为已使用，如果没有空闲页面，就返回0.
  * 
- * 取空闲页面。如果已经没有可用内存了，则返回0。本函数从字节图末端开始向前扫描
- * 所有页面标志(页面总数为PAGING_PAGES)，若有页面空闲(其内存映像字节为0)则返回页面地址。
- * 注意！本函数只是指出在主内存区的一页空闲页面，但并没有映射到某个进程的线性地址去。后面
- * 的put_page()函数就是用来作映射的.
+ * 注意！本函数只是指出在主内存区的一页空闲页面，但并没有映射到某个进程的线性地址去。
+ * 后面的put_page()函数就是用来作映射的.
  */
 unsigned long get_free_page(void)
 {
-    register unsigned long __res asm("ax");
+    if (zero_pool_nr)
+        return zero_pool[--zero_pool_nr];
 
-    __asm__("std ; repne ; scasb\n\t"   /* 方向位置位，将al(0)与对应每个页面的(di)内容比较. */
-            "jne 1f\n\t"                /* 如果没有等于0的字节，则跳转结束(返回0). */
-            "movb $1,1(%%edi)\n\t"      /* 将对应页面的内存映像位置1. */
-            "sall $12,%%ecx\n\t"        /* 页面数*4K = 相对页面起始地址. */
-            "addl %2,%%ecx\n\t"         /* 再加上低端内存地址，即获得页面实际物理起始地址. */
-            "movl %%ecx,%%edx\n\t"      /* 将页面实际起始地址??edx 寄存器. */
-            "movl $1024,%%ecx\n\t"      /* 寄存器ecx置计数值1024. */
-            "leal 4092(%%edx),%%edi\n\t"/* 将4092+edx的位置??edi(该页面的末端). */
-            "rep ; stosl\n\t"           /* 将edi所指内存清零(反方向，也即将该页面清零). */
-            "movl %%edx,%%eax\n"        /* 将页面起始地址??eax(返回值). */
-            "1:"
-            : "=a"(__res)
-            : "0"(0), "i"(LOW_MEM), "c"(PAGING_PAGES),
-              "D"(mem_map + PAGING_PAGES - 1)
-            : "di", "cx", "dx");
+    return get_free_pages(0);
+}
 
-    /* 返回空闲页面地址(如果无空闲也则返回0). */
-    return __res;
+/**
+ * 与get_free_page()相同，但没有空闲页面时不回收内存(不会睡眠)，直接返回0。
+ * 用于中断处理程序中的分配.
+ */
+unsigned long get_free_page_atomic(void)
+{
+    unsigned long page;
+
+    if (zero_pool_nr)
+        return zero_pool[--zero_pool_nr];
+
+    if (page = alloc_pages(0, 0))
+        zero_pages(page, 1);
+
+    return page;
+}
+
+/**
+ * 任务0空闲时调用：若池未满且空闲页面充足，则取一个空闲页面清零后放入池中。
+ * 每次只清零一页，清零时中断是开着的，所以被唤醒的进程最多等一页的时间.
+ * 放入了页面返回1.
+ */
+int fill_zero_pool(void)
+{
+    unsigned long page;
+
+    if (zero_pool_nr >= ZERO_POOL_PAGES || nr_free_pages <= paging_pages / ZERO_POOL_FREE)
+        return 0;
+
+    if (!(page = alloc_pages(0, 0)))
+        return 0;
+
+    zero_pages(page, 1);
+    zero_pool[zero_pool_nr++] = page;
+
+    return 1;
 }
 
 /**
  * 释放物理地址'addr'开始的一页内存。用于函数'free_page_tables()'.
  * 1MB以下的内存空间用于内核程序和缓冲，不作为分配页面的内存空间. 
+ * 页面引用计数减为0时，才真正放回伙伴系统(并与其空闲的伙伴块合并).
  */
 void free_page(unsigned long addr)
 {
@@ -131,16 +516,29 @@ void free_page(unsigned long addr)
         panic("trying to free nonexistent page");
 
     /* 物理地址减去低端内存位置，再除以4KB，得页面号. */
-    addr -= LOW_MEM;
-    addr >>= 12;
+    addr = MAP_NR(addr);
+
+    /* 如果对应内存页面映射字节已经为0，则显示出错信息，死机. */
+    if (!mem_map[addr])
+        panic("trying to free free page");
 
-    /* 如果对应内存页面映射字节不等于0，则减1返回. */
-    if (mem_map[addr]--)
+    /* 引用计数减1，若还有其它引用者则返回. */
+    if (--mem_map[addr])
         return;
 
-    /* 否则置对应页面映射字节为0，并显示出错信息，死机. */
-    mem_map[addr] = 0;
-    panic("trying to free free page");
+    free_pages_ok(addr, 0);
+}
+
+/**
+ * 释放由get_free_pages()取得的、从addr开始的(1 << order)个连续页面.
+ * 各页面是分别计数的，其中仍被共享的页面会保留到最后一个引用者释放为止.
+ */
+void free_pages(unsigned long addr, int order)
+{
+    int i;
+
+    for (i = 0; i < (1 << order); i++, addr += 4096)
+        free_page(addr);
 }
 
 /**
@@ -156,7 +554,8 @@ void free_page(unsigned long addr)
 int free_page_tables(unsigned long from, unsigned long size)
 {
     unsigned long *pg_table;
-    unsigned long *dir, nr;
+    unsigned long *dir, nr, address;
+    long rss = 0;
 
     /* 要释放内存块的地址需以4M为边界. */
     if (from & 0x3fffff)
@@ -184,15 +583,44 @@ int free_page_tables(unsigned long from, unsigned long size)
         if (!(1 & *dir))
             continue;
 
-        /* 取目录项中页表地址. */
+        /* 取目录项中页表地址，以及该页表管辖的线性地址. */
         pg_table = (unsigned long *)(0xfffff000 & *dir);
+        address = (unsigned long)dir << 20;
+
+        /**
+         * 页表还与其它进程共享(见copy_page_tables())，则只递减页表的引用计数。
+         * 本进程经由这个页表访问过的页面在TLB中可能还有项，也要刷新.
+         */
+        if (mem_map[MAP_NR((unsigned long)pg_table)] > 1)
+        {
+            for (nr = 0; nr < 1024; nr++)
+                if (1 & pg_table[nr])
+                {
+                    tlb_batch_add(address + (nr << 12));
+
+                    if ((0xfffff000 & pg_table[nr]) >= LOW_MEM)
+                        rss++;
+                }
+
+            free_page((unsigned long)pg_table);
+            *dir = 0;
+            continue;
+        }
 
         /* 每个页表有1024个页项. */
         for (nr = 0; nr < 1024; nr++)
         {
-            /* 若该页表项有效(P位=1)，则释放对应内存页. */
+            /* 若该页表项有效(P位=1)，则释放对应内存页，若页面已被换出则释放交换页. */
             if (1 & *pg_table)
+            {
+                if ((0xfffff000 & *pg_table) >= LOW_MEM)
+                    rss++;
+
                 free_page(0xfffff000 & *pg_table);
+                tlb_batch_add(address + (nr << 12));
+            }
+            else if (*pg_table)
+                swap_free(*pg_table >> 1);
 
             /* 该页表项内容清零. */
             *pg_table = 0;
@@ -208,8 +636,13 @@ int free_page_tables(unsigned long from, unsigned long size)
         *dir = 0;
     }
 
-    /* 刷新页变换高速缓冲. */
-    invalidate();
+    /**
+     * 刷新页变换高速缓冲。CPU可能还缓存着已清除的目录项，任何一条invlpg都会把这种
+     * 缓存一起作废，所以至少刷新一页.
+     */
+    tlb_batch_add(from);
+    flush_tlb_batch();
+    rss_add(from, -rss);
 
     return 0;
 }
@@ -226,6 +659,11 @@ int free_page_tables(unsigned long from, unsigned long size)
  * 640kB。即使是复制这些页面也已经超出我们的需求但这不会占用更多的内存 - 在低1Mb内存
  * 范围内我们不执行写时复制操作，所以这些页面可以与内核共享。因此这是nr=xxxx的特殊情况
  * (nr在程序中指页面数).
+ *
+ * 注意3!!! 除上面的特殊情况外，现在并不复制页表，而是让两个目录项指向同一个页表，
+ * 把两个目录项都置为只读，并递增页表页面的引用计数。这样fork()的开销与父进程的大小
+ * 无关，子进程马上执行execve()时页表根本不用复制。哪个进程先写这4MB中的某页，就在
+ * 写保护异常中为它复制一份页表(unshare_page_table())，之后再按页写时复制.
  */
 
 /**
@@ -239,7 +677,7 @@ int copy_page_tables(unsigned long from, unsigned long to, long size)
 {
     unsigned long *from_page_table;
     unsigned long *to_page_table;
-    unsigned long this_page;
+    unsigned long this_page, new_page;
     unsigned long *from_dir, *to_dir;
     unsigned long nr;
 
@@ -268,6 +706,23 @@ int copy_page_tables(unsigned long from, unsigned long to, long size)
         /* 取当前源目录项中页表的地址??from_page_table. */
         from_page_table = (unsigned long *)(0xfffff000 & *from_dir);
 
+        /**
+         * 共享页表：父子进程的目录项指向同一页表，且都置为只读。父进程原来可写的页面
+         * 在TLB中可能还是可写的，要刷新.
+         */
+        if (from)
+        {
+            if (2 & *from_dir)
+                for (nr = 0; nr < 1024; nr++)
+                    if ((3 & from_page_table[nr]) == 3)
+                        tlb_batch_add(((unsigned long)from_dir << 20) + (nr << 12));
+
+            *from_dir &= ~2;
+            *to_dir = *from_dir;
+            mem_map[MAP_NR((unsigned long)from_page_table)]++;
+            continue;
+        }
+
         /* 为目的页表取一页空闲内存，如果返回是0则说明没有申请到空闲内存页面。返回值=-1，退出. */
         if (!(to_page_table = (unsigned long *)get_free_page()))
             return -1; /* Out of memory, see freeing */
@@ -275,6 +730,18 @@ int copy_page_tables(unsigned long from, unsigned long to, long size)
         /* 设置目的目录项信息。7是标志信息，表示(Usr, R/W, Present). */
         *to_dir = ((unsigned long)to_page_table) | 7;
 
+        /**
+         * 内核恒等映射用的是4MB页(见head.s)，没有源页表可复制，直接为头160页生成
+         * 只读的页表项(都在1MB以下，不需要修改mem_map[]).
+         */
+        if (PAGE_4M & *from_dir)
+        {
+            for (nr = 0; nr < 0xA0; nr++)
+                to_page_table[nr] = ((*from_dir & 0xffc00000) + (nr << 12)) | 5;
+
+            continue;
+        }
+
         /**
          * 针对当前处理的页表，设置需复制的页面数。如果是在内核空间，
          * 则仅需复制头160页，否则需要复制 1 个页表中的所有1024页面. 
@@ -288,8 +755,29 @@ int copy_page_tables(unsigned long from, unsigned long to, long size)
             this_page = *from_page_table;
 
             /* 如果当前源页面没有使用，则不用复制. */
+            if (!this_page)
+                continue;
+
+            /**
+             * 如果源页面已被换出，则把它读回到一个新页面给父进程使用，交换页留给子进程.
+             * 这样一个交换页始终只属于一个页表项.
+             */
             if (!(1 & this_page))
+            {
+                if (!(new_page = get_free_page()))
+                    return -1;
+
+                if (!read_swap_page(this_page >> 1, (char *)new_page))
+                {
+                    free_page(new_page);
+                    return -1;
+                }
+
+                *to_page_table = this_page;
+                *from_page_table = new_page | (PAGE_DIRTY | 7);
+                current->rss++;
                 continue;
+            }
 
             /**
              * 复位页表项中R/W标志(置0)。(如果U/S位是0，则R/W就没有作用。
@@ -320,11 +808,39 @@ int copy_page_tables(unsigned long from, unsigned long to, long size)
     }
 
     /* 刷新页变换高速缓冲. */
-    invalidate();
+    flush_tlb_batch();
 
     return 0;
 }
 
+/**
+ * 取线性地址address对应的页表项指针。若页表还不存在则分配一个，若页表与其它进程
+ * 共享则先取消共享，所以返回的页表项可以直接修改。内存不够时返回NULL.
+ */
+unsigned long *get_page_entry(unsigned long address)
+{
+    unsigned long tmp, *dir;
+
+    /* 注意!!!这里使用了页目录基址_pg_dir=0的条件. */
+    dir = (unsigned long *)((address >> 20) & 0xffc);
+
+    if (!(1 & *dir))
+    {
+        if (!(tmp = get_free_page()))
+            return NULL;
+
+        /* get_free_page()可能睡眠，睡眠期间目录项可能已经变化，所以再检查一次. */
+        if (1 & *dir)
+            free_page(tmp);
+        else
+            *dir = tmp | 7;
+    }
+    else if (!(2 & *dir))
+        unshare_page_table(dir);
+
+    return ((address >> 10) & 0xffc) + (unsigned long *)(0xfffff000 & *dir);
+}
+
 /**
  * 下面函数将一内存页面放置在指定地址处。它返回页面的物理地址，如果
  * 内存不够(在访问页表或页面时)，则返回0.
@@ -334,9 +850,8 @@ int copy_page_tables(unsigned long from, unsigned long to, long size)
  */
 unsigned long put_page(unsigned long page, unsigned long address)
 {
-    unsigned long tmp, *page_table;
+    unsigned long *page_table;
 
-    /* 注意!!!这里使用了页目录基址_pg_dir=0的条件. */
 
     /**
      * 如果申请的页面位置低于LOW_MEM(1Mb)或超出系统实际含有
@@ -349,41 +864,45 @@ unsigned long put_page(unsigned long page, unsigned long address)
     if (mem_map[(page - LOW_MEM) >> 12] != 1)
         printk("mem_map disagrees with %p at %p\n", page, address);
 
-    /* 计算指定地址在页目录表中对应的目录项指针. */
-    page_table = (unsigned long *)((address >> 20) & 0xffc);
-
     /**
-     * 如果该目录项有效(P=1)(也即指定的页表在内存中)，
-     * 则从中取得指定页表的地址??page_table.
+     * 取指定地址的页表项。如果页表不存在，则申请空闲页面给页表使用，并在对应目录项中
+     * 置相应标志7(User, U/S, R/W)。共享的页表要先复制一份，因为两个进程的映射此后
+     * 可能不同(例如mmap()).
      */
-    if ((*page_table) & 1)
-        page_table = (unsigned long *)(0xfffff000 & *page_table);
-    else
-    {
-        /**
-         * 否则，申请空闲页面给页表使用，并在对应目录项中置相应标志7(User, U/S, R/W),
-         * 然后将该页表的地址??page_table.
-         */
-        if (!(tmp = get_free_page()))
-            return 0;
-
-        *page_table = tmp | 7;
-        page_table = (unsigned long *)tmp;
-    }
+    if (!(page_table = get_page_entry(address)))
+        return 0;
 
-    /* 在页表中设置指定地址的物理内存页面的页表项内容。每个页表共可有1024项(0x3ff). */
-    page_table[(address >> 12) & 0x3ff] = page | 7;
+    /* 在页表中设置指定地址的物理内存页面的页表项内容. */
+    *page_table = page | 7;
+    rss_add(address, 1);
 
     /* 不需要刷新页变换高速缓冲,返回页面地址. */
     return page;
 }
 
+/**
+ * 与put_page()相同，只是同时置页表项的已修改标志(D=1)。用于放置内容既不来自执行文件、
+ * 也不是全0的页面(例如execve()的参数页面)，这样的页面即使没被写过也不能被直接丢弃.
+ */
+unsigned long put_dirty_page(unsigned long page, unsigned long address)
+{
+    unsigned long *page_table;
+
+    if (!put_page(page, address))
+        return 0;
+
+    page_table = (unsigned long *)(0xfffff000 & pg_dir[address >> 22]);
+    page_table[(address >> 12) & 0x3ff] |= PAGE_DIRTY;
+
+    return page;
+}
+
 /**
  * 取消写保护页面函数。用于页异常中断过程中写保护异常的处理(写时复制)。
- * 输入参数为页表项指针.
+ * 输入参数为页表项指针及其对应的线性地址(用于刷新该页的TLB项).
  * [un_wp_page意思是取消页面的写保护：Un-Write Protected.]
  */
-void un_wp_page(unsigned long *table_entry)
+void un_wp_page(unsigned long *table_entry, unsigned long address)
 {
     unsigned long old_page, new_page;
 
@@ -398,7 +917,7 @@ void un_wp_page(unsigned long *table_entry)
     if (old_page >= LOW_MEM && mem_map[MAP_NR(old_page)] == 1)
     {
         *table_entry |= 2;
-        invalidate();
+        invalidate_page(address);
         return;
     }
 
@@ -409,6 +928,16 @@ void un_wp_page(unsigned long *table_entry)
     if (!(new_page = get_free_page()))
         oom();
 
+    /**
+     * get_free_page()可能因换出页面而睡眠，期间原页面可能已被换出。这时放弃复制，
+     * 再次访问该页面时会重新产生缺页异常.
+     */
+    if ((*table_entry & 0xfffff001) != (old_page | 1))
+    {
+        free_page(new_page);
+        return;
+    }
+
     /**
      * 如果原页面大于内存低端(则意味着 mem_map[]>1，页面是共享的)，则将原页面
      * 的页面映射数组值递减 1。然后将指定页表项内容更新为新页面的地址，并置可读写
@@ -418,11 +947,84 @@ void un_wp_page(unsigned long *table_entry)
     if (old_page >= LOW_MEM)
         mem_map[MAP_NR(old_page)]--;
 
-    *table_entry = new_page | 7;
-    invalidate();
+    /* 新页面是原页面的副本，不能在换出时被丢弃，所以置为脏页. */
+    *table_entry = new_page | (PAGE_DIRTY | 7);
+    invalidate_page(address);
     copy_page(old_page, new_page);
 }
 
+/**
+ * 取消目录项dir所指页表的共享，使当前进程可以写这个页表所管辖的4MB空间。
+ * 若页表只剩当前进程在用，则只需恢复目录项的可写标志；否则为当前进程复制一份页表，
+ * 表中每个页面的引用计数加1，并在新旧两个页表中都置为只读，以后再按页写时复制。
+ * 交换页只能属于一个页表项，所以复制之前先把旧页表中已换出的页面都换入。
+ * 改的是目录项，影响整个4MB，所以这里仍重新加载cr3刷新TLB.
+ */
+void unshare_page_table(unsigned long *dir)
+{
+    unsigned long old_table, new_table, this_page;
+    unsigned long *from, *to;
+    int nr;
+
+    old_table = 0xfffff000 & *dir;
+
+    if (mem_map[MAP_NR(old_table)] == 1)
+    {
+        *dir |= 2;
+        invalidate();
+        return;
+    }
+
+    if (!(new_table = get_free_page()))
+        oom();
+
+    /* 上面以及swap_in()都可能睡眠，期间共享该页表的其它进程可能已经退出. */
+repeat:
+    if (mem_map[MAP_NR(old_table)] == 1)
+    {
+        free_page(new_table);
+        *dir |= 2;
+        invalidate();
+        return;
+    }
+
+    from = (unsigned long *)old_table;
+
+    /**
+     * 页面读不回来时不能只复制其余的页表项，而共享的页表又不能让当前进程写，只好
+     * 结束当前进程(与SIGBUS的默认处理相同).
+     */
+    for (nr = 0; nr < 1024; nr++)
+        if (from[nr] && !(1 & from[nr]))
+        {
+            if (!swap_in(from + nr))
+            {
+                free_page(new_table);
+                do_exit(1 << (SIGBUS - 1));
+            }
+
+            goto repeat;
+        }
+
+    to = (unsigned long *)new_table;
+
+    for (nr = 0; nr < 1024; nr++)
+    {
+        if (!(1 & (this_page = from[nr])))
+            continue;
+
+        this_page &= ~2;
+        from[nr] = to[nr] = this_page;
+
+        if (this_page >= LOW_MEM)
+            mem_map[MAP_NR(this_page)]++;
+    }
+
+    mem_map[MAP_NR(old_table)]--;
+    *dir = new_table | 7;
+    invalidate();
+}
+
 /**
  * 当用户试图往一个共享页面上写时，该函数处理已存在的内存页面，(写时复制)
  * 它是通过将页面复制到一个新地址上并递减原页面的共享页面计数值实现的。
@@ -437,6 +1039,8 @@ void un_wp_page(unsigned long *table_entry)
  */
 void do_wp_page(unsigned long error_code, unsigned long address)
 {
+    unsigned long *dir, *table_entry;
+
 #if 0
     /* 我们现在还不能这样做：因为estdio库会在代码空间执行写操作. */
     /* 真是太愚蠢了。我真想从GNU得到libc.a库. */
@@ -452,30 +1056,72 @@ void do_wp_page(unsigned long error_code, unsigned long address)
      * (0xfffff000 &((address>>20) &0xffc))：取目录项中页表的地址值，
      * 其中((address>>20) &0xffc)计算页面所在页表的目录项指针；
      * 两者相加即得指定地址对应页面的页表项指针。这里对共享的页面进行复制.
+     * 若页表本身是与其它进程共享的(目录项只读)，则要先取消页表的共享.
+     */
+    dir = (unsigned long *)((address >> 20) & 0xffc);
+
+    if (!(2 & *dir))
+        unshare_page_table(dir);
+
+    table_entry = (unsigned long *)(((address >> 10) & 0xffc) + (0xfffff000 & *dir));
+
+    /**
+     * 页表复制后页面可能已经可写(只是目录项只读引起的异常)；复制页表时也可能睡眠，
+     * 期间页面可能已被换出，这时返回即可，再次访问时会产生缺页异常.
      */
-    un_wp_page((unsigned long *)(((address >> 10) & 0xffc) +
-                (0xfffff000 & *((unsigned long *)((address >> 20) & 0xffc)))));
+    if ((3 & *table_entry) != 1)
+        return;
+
+    /* 文件映射区有自己的处理方式(共享映射直接可写，只读映射则出错). */
+    if (mmap_wp_page(address, table_entry))
+        return;
+
+    count_fault(cow_flt);
+    un_wp_page(table_entry, address);
 }
 
 /**
  * 写页面验证。
  * 若页面不可写，则复制页面。在fork.c中被调用.
+ *
+ * 内核写用户空间时不理会写保护。代码数据区和映射区中不在内存的页面，若等内核写入
+ * 时才缺页调入，得到的可能是执行文件页面缓存(或别的进程私有映射)中只读共享的页面，
+ * 写入的内容就会被其它进程看到，所以先调入，再按下面的写时复制处理.
  */
 void write_verify(unsigned long address)
 {
-    unsigned long page;
+    unsigned long page, offset;
+
+    offset = address - current->start_code;
+    page = *((unsigned long *)((address >> 20) & 0xffc));
+
+    if (!(page & PAGE_4M) && (offset < current->end_data || find_vma(offset)))
+        if (!(page & 1) ||
+            !(1 & *(unsigned long *)((page & 0xfffff000) + ((address >> 10) & 0xffc))))
+            do_no_page(2, address);
 
-    /* 判断指定地址所对应页目录项的页表是否存在(P)，若不存在(P=0)则返回. */
-    if (!((page = *((unsigned long *)((address >> 20) & 0xffc))) & 1))
+    /* 判断指定地址所对应页目录项的页表是否存在(P)，若不存在(P=0)或是4MB页则返回. */
+    if (!((page = *((unsigned long *)((address >> 20) & 0xffc))) & 1) || (page & PAGE_4M))
         return;
 
+    /**
+     * 内核写用户空间时不理会写保护，所以若页表是共享的，必须先取消共享，
+     * 否则会写到其它进程也能看到的页面上.
+     */
+    if (!(page & 2))
+    {
+        unshare_page_table((unsigned long *)((address >> 20) & 0xffc));
+        page = *((unsigned long *)((address >> 20) & 0xffc));
+    }
+
     /* 取页表的地址，加上指定地址的页面在页表中的页表项偏移值，得对应物理页面的页表项指针. */
     page &= 0xfffff000;
     page += ((address >> 10) & 0xffc);
 
     /* 如果该页面不可写(标志R/W没有置位)，则执行共享检验和复制页面操作(写时复制). */
     if ((3 & *(unsigned long *)page) == 1) /* non-writeable, present */
-        un_wp_page((unsigned long *)page);
+        if (!mmap_wp_page(address, (unsigned long *)page))
+            un_wp_page((unsigned long *)page, address);
 
     return;
 }
@@ -490,6 +1136,9 @@ void get_empty_page(unsigned long address)
 {
     unsigned long tmp;
 
+    /* 缺页时才会调用，页面是清零得到的，不需读盘. */
+    count_fault(min_flt);
+
     /**
      * 若不能取得一空闲页面，或者不能将页面放置到指定地址处，则显示内存不够的信息.
      * 即使执行get_free_page()返回0也无所谓，因为put_page()中还会对此情况再次
@@ -503,139 +1152,154 @@ void get_empty_page(unsigned long address)
 }
 
 /**
- * try_to_share()在任务"p"中检查位于地址"address"处的页面，看页面是否存在，是否干净。
- * 如果是干净的话，就与当前任务共享。
- *
- * 注意！这里我们已假定p!=当前任务，并且它们共享同一个执行程序.
- */
-
-/**
- * 尝试对进程指定地址处的页面进行共享操作.
- * 同时还验证指定的地址处是否已经申请了页面，若是则出错，死机。
- * 返回 1-成功，0-失败.
+ * 把执行文件页面缓存中的页面page映射到线性地址address处。页面同时被缓存和(可能)
+ * 其它进程使用，所以映射为只读，写时复制。成功返回1.
  */
-static int try_to_share(unsigned long address, struct task_struct *p)
+static int put_cache_page(unsigned long page, unsigned long address)
 {
-    unsigned long from;
-    unsigned long to;
-    unsigned long from_page;
-    unsigned long to_page;
-    unsigned long phys_addr;
+    unsigned long *page_table;
 
-    /* 求指定内存地址的页目录项. */
-    from_page = to_page = ((address >> 20) & 0xffc);
+    if (!(page_table = get_page_entry(address)))
+        return 0;
 
-    /* 计算进程p的代码起始地址所对应的页目录项. */
-    from_page += ((p->start_code >> 20) & 0xffc);
+    *page_table = page | (PAGE_USER | PAGE_PRESENT);
+    rss_add(address, 1);
 
-    /* 计算当前进程中代码起始地址所对应的页目录项. */
-    to_page += ((current->start_code >> 20) & 0xffc);
+    return 1;
+}
 
-    /**
-     * 在from处是否存在页目录?
-     * 对p进程页面进行操作取页目录项内容。如果该目录项无效(P=0)，
-     * 则返回。否则取该目录项对应页表地址??from.
-     */
-    from = *(unsigned long *)from_page;
+/**
+ * 缺页时顺便映射的窗口大小(页数，必须是2的幂，窗口按其大小对齐)，以及窗口之后
+ * 发出异步预读的页数。只有空闲页面多于全部分页内存的1/FAULT_AROUND_FREE时才这样做，
+ * 否则内存紧张时会把可能用不到的页面读进来.
+ */
+#define FAULT_AROUND_PAGES      16
+#define READ_AHEAD_PAGES        8
+#define FAULT_AROUND_FREE       8
 
-    if (!(from & 1))
-        return 0;
+/**
+ * 取执行文件中偏移tmp处一页所在的4个逻辑块号(第1块是执行文件头，所以要加1).
+ */
+static void exec_page_blocks(unsigned long tmp, int nr[4])
+{
+    int block, i;
 
-    from &= 0xfffff000;
+    block = 1 + tmp / BLOCK_SIZE;
 
-    /* 计算地址对应的页表项指针值，并取出该页表项内容??phys_addr. */
-    from_page = from + ((address >> 10) & 0xffc);
-    phys_addr = *(unsigned long *)from_page;
+    for (i = 0; i < 4; block++, i++)
+        nr[i] = bmap(current->executable, block);
+}
 
-    /* 页面干净并且存在吗? */
-    /* 0x41 对应页表项中的Dirty和Present标志。如果页面不干净或无效则返回. */
-    if ((phys_addr & 0x41) != 0x01)
-        return 0;
+/**
+ * 若执行文件中偏移tmp处的一页数据已全部在高速缓冲中，则把它复制到一个新页面并映射到
+ * 线性地址address处，不进行任何读盘操作。成功返回1.
+ */
+static int map_cached_page(unsigned long address, unsigned long tmp)
+{
+    struct buffer_head *bh[4];
+    unsigned long page;
+    int nr[4], i, ok = 1;
 
-    /* 取页面的地址??phys_addr。如果该页面地址不存在或小于内存低端(1M)也返回退出. */
-    phys_addr &= 0xfffff000;
+    exec_page_blocks(tmp, nr);
 
-    if (phys_addr >= HIGH_MEMORY || phys_addr < LOW_MEM)
-        return 0;
+    for (i = 0; i < 4; i++)
+    {
+        bh[i] = NULL;
 
-    /**
-     * 对当前进程页面进行操作。
-     * 取页目录项内容??to。如果该目录项无效(P=0)，则取空闲页面，并更新to_page所指的目录项.
-     */
-    to = *(unsigned long *)to_page;
+        if (nr[i] && (!(bh[i] = get_hash_table(current->executable->i_dev, nr[i])) ||
+                      !bh[i]->b_uptodate))
+            ok = 0;
+    }
 
-    if (!(to & 1))
-        if (to = get_free_page())
-            *(unsigned long *)to_page = to | 7;
-        else
-            oom();
+    page = 0;
 
-    /* 取对应页表地址??to，页表项地址??to_page。如果对应的页面已经存在，则出错，死机. */
-    to &= 0xfffff000;
-    to_page = to + ((address >> 10) & 0xffc);
+    if (ok && (page = get_free_page()))
+        for (i = 0; i < 4; i++)
+            if (bh[i])
+                memcpy((char *)page + i * BLOCK_SIZE, bh[i]->b_data, BLOCK_SIZE);
 
-    if (1 & *(unsigned long *)to_page)
-        panic("try_to_share: to_page already exists");
+    for (i = 0; i < 4; i++)
+        brelse(bh[i]);
 
-    /* 对它们进行共享处理：写保护. */
-    /* 对p进程中页面置写保护标志(置 R/W=0 只读)。并且当前进程中的对应页表项指向它. */
-    *(unsigned long *)from_page &= ~2;
-    *(unsigned long *)to_page = *(unsigned long *)from_page;
+    if (!page)
+        return 0;
 
-    /* 刷新页变换高速缓冲. */
-    invalidate();
+    /* 超出end_data的部分清零. */
+    if (tmp + PAGE_SIZE > current->end_data)
+    {
+        i = current->end_data - tmp;
+        memset((char *)page + i, 0, PAGE_SIZE - i);
+    }
 
-    /* 计算所操作页面的页面号，并将对应页面映射数组项中的引用递增1. */
-    phys_addr -= LOW_MEM;
-    phys_addr >>= 12;
-    mem_map[phys_addr]++;
+    if (add_cache_page(current->executable, tmp, page) ?
+        put_cache_page(page, address) : put_page(page, address))
+        return 1;
 
-    return 1;
+    free_page(page);
+
+    return 0;
 }
 
 /**
- * share_page()试图找到一个进程，它可以与当前进程共享页面。参数address是
- * 当前数据空间中期望共享的某页面地址。
- *
- * 首先我们通过检测executable->i_count来查证是否可行。如果有其它任务已共享
- * 该inode，则它应该大于1.
- *
- * 共享页面。在缺页处理时看看能否共享页面。
- * 返回 1 - 成功，0 - 失败.
+ * 缺页预映射(fault-around)：执行文件的页面在缺页异常中映射后，把同一窗口中其它尚未
+ * 映射、但已在页面缓存中或者数据已在高速缓冲中的页面也一起映射进来，这些页面
+ * 以后就不会再产生缺页异常。然后对窗口之后的几页发出异步预读(READA)，不等待读盘
+ * 完成，等执行到那里时数据多半已在高速缓冲中了.
  */
-static int share_page(unsigned long address)
+static void fault_around(unsigned long address)
 {
-    struct task_struct **p;
+    unsigned long start, addr, tmp, page, *page_table;
+    struct buffer_head *bh;
+    int nr[4], i, j;
 
-    /* 如果是不可执行的，则返回。excutable是执行进程的内存i节点结构. */
-    if (!current->executable)
-        return 0;
+    if (nr_free_pages < paging_pages / FAULT_AROUND_FREE)
+        return;
 
-    /* 如果只能单独执行(executable->i_count=1)，也退出. */
-    if (current->executable->i_count < 2)
-        return 0;
+    start = address & ~(FAULT_AROUND_PAGES * PAGE_SIZE - 1);
 
-    /* 搜索任务数组中所有任务。寻找与当前进程可共享页面的进程，并尝试对指定地址的页面进行共享. */
-    for (p = &LAST_TASK; p > &FIRST_TASK; --p)
+    for (addr = start; addr < start + FAULT_AROUND_PAGES * PAGE_SIZE; addr += PAGE_SIZE)
     {
-        /* 如果该任务项空闲，则继续寻找. */
-        if (!*p)
-            continue;
+        tmp = addr - current->start_code;
 
-        /* 如果就是当前任务，也继续寻找. */
-        if (current == *p)
-            continue;
+        if (tmp >= current->end_data)
+            break;
+
+        /* 窗口在同一个页表中(刚映射过address，页表一定存在)，已映射或已换出的页不管. */
+        page_table = (unsigned long *)(0xfffff000 & pg_dir[addr >> 22]);
 
-        /* 如果 executable 不等，也继续寻找. */
-        if ((*p)->executable != current->executable)
+        if (page_table[(addr >> 12) & 0x3ff])
             continue;
 
-        /* 尝试共享页面. */
-        if (try_to_share(address, *p))
-            return 1;
+        if (page = find_cache_page(current->executable, tmp))
+        {
+            if (!put_cache_page(page, addr))
+                free_page(page);
+        }
+        else
+            map_cached_page(addr, tmp);
     }
 
-    return 0;
+    for (i = 0; i < READ_AHEAD_PAGES; i++, addr += PAGE_SIZE)
+    {
+        tmp = addr - current->start_code;
+
+        if (tmp >= current->end_data)
+            break;
+
+        exec_page_blocks(tmp, nr);
+
+        for (j = 0; j < 4; j++)
+        {
+            if (!nr[j] || !(bh = getblk(current->executable->i_dev, nr[j])))
+                continue;
+
+            if (!bh->b_uptodate)
+                ll_rw_block(READA, bh);
+
+            /* 与breada()一样直接递减引用计数，brelse()会等待读盘完成. */
+            bh->b_count--;
+        }
+    }
 }
 
 /**
@@ -646,13 +1310,37 @@ static int share_page(unsigned long address)
 void do_no_page(unsigned long error_code, unsigned long address)
 {
     int nr[4];
-    unsigned long tmp;
+    unsigned long tmp, offset;
     unsigned long page;
-    int block, i;
+    int i;
 
     /* 页面地址. */
     address &= 0xfffff000;
 
+    /* 如果该页面已被换出(页表项不为0但P=0)，则把它换入即可. */
+    page = *(unsigned long *)((address >> 20) & 0xffc);
+
+    if (page & 1)
+    {
+        page &= 0xfffff000;
+        page += (address >> 10) & 0xffc;
+        tmp = *(unsigned long *)page;
+
+        if (tmp && !(1 & tmp))
+        {
+            count_fault(maj_flt);
+
+            if (swap_in((unsigned long *)page))
+                rss_add(address, 1);
+
+            return;
+        }
+    }
+
+    /* 缺页在文件映射区中，则从文件读入(或与其它进程共享). */
+    if (do_mmap_page(address))
+        return;
+
     /* 首先算出指定线性地址在进程空间中相对于进程基址的偏移长度值. */
     tmp = address - current->start_code;
 
@@ -671,9 +1359,23 @@ void do_no_page(unsigned long error_code, unsigned long address)
         return;
     }
 
-    /* 如果尝试共享页面成功，则退出. */
-    if (share_page(tmp))
+    /**
+     * 页面已在执行文件页面缓存中(有进程正在使用，或者以前执行过该文件)，则直接共享，
+     * 不必读盘.
+     */
+    if (page = find_cache_page(current->executable, tmp))
+    {
+        count_fault(min_flt);
+
+        if (!put_cache_page(page, address))
+        {
+            free_page(page);
+            oom();
+        }
+
+        fault_around(address);
         return;
+    }
 
     /* 取空闲页面，如果内存不够了，则显示内存不够，终止进程. */
     if (!(page = get_free_page()))
@@ -681,20 +1383,29 @@ void do_no_page(unsigned long error_code, unsigned long address)
 
     /* 记住，(程序)头要使用1个数据块. */
     /* 首先计算缺页所在的数据块项。BLOCK_SIZE=1024字节，因此一页内存需要4个数据块. */
-    block = 1 + tmp / BLOCK_SIZE;
-
     /* 根据i节点信息，取数据块在设备上的对应的逻辑块号. */
-    for (i = 0; i < 4; block++, i++)
-        nr[i] = bmap(current->executable, block);
+    exec_page_blocks(tmp, nr);
+
+    /**
+     * 读设备上一个页面的数据(4个逻辑块)到指定物理地址page处。读盘出错时不能把页面
+     * 放入页面缓存，否则以后执行该文件的进程都会用到错误的内容。与换入出错一样发
+     * SIGBUS信号，不映射页面.
+     */
+    count_fault(maj_flt);
 
-    /* 读设备上一个页面的数据(4个逻辑块)到指定物理地址page处. */
-    bread_page(page, current->executable->i_dev, nr);
+    if (!bread_page(page, current->executable->i_dev, nr))
+    {
+        free_page(page);
+        current->signal |= 1 << (SIGBUS - 1);
+        return;
+    }
 
     /**
      * 在增加了一页内存后，该页内存的部分可能会超过进程的end_data位置。下面的循环即是
      * 对物理页面超出的部分进行清零处理. 
      */
     i = tmp + 4096 - current->end_data;
+    offset = tmp;
     tmp = page + 4096;
 
     while (i-- > 0)
@@ -703,24 +1414,103 @@ void do_no_page(unsigned long error_code, unsigned long address)
         *(char *)tmp = 0;
     }
 
-    /* 如果把物理页面映射到指定线性地址的操作成功，就返回。否则就释放内存页，显示内存不够. */
-    if (put_page(page, address))
+    /**
+     * 如果把物理页面映射到指定线性地址的操作成功，就返回。否则就释放内存页，显示内存不够.
+     * 页面加入了页面缓存的话要映射为只读.
+     */
+    if (add_cache_page(current->executable, offset, page) ?
+        put_cache_page(page, address) : put_page(page, address))
+    {
+        /* 顺便映射相邻的页面，并预读后面的页面. */
+        fault_around(address);
         return;
+    }
 
     free_page(page);
     oom();
 }
 
+/**
+ * 将物理地址[start, end)之内的完整页面逐个放入伙伴系统，相邻的空闲页面会自动合并成大块.
+ */
+static void mem_free_range(unsigned long start, unsigned long end)
+{
+    start = PAGE_ALIGN(start);
+    end &= 0xfffff000;
+
+    for (; start < end; start += PAGE_SIZE)
+    {
+        mem_map[MAP_NR(start)] = 0;
+        free_pages_ok(MAP_NR(start), 0);
+    }
+}
+
+/**
+ * 按实际内存大小建立内存管理所需的数据结构.
+ * head.s只为物理内存的前16MB建立了恒等映射页表，这里为16MB以上直到end_mem的内存
+ * 补充内核页表(放在任务0的64MB线性空间中，即页目录项4-15)，然后在其后分配mem_map[]
+ * 和page_order[]数组。CPU支持4MB页时与head.s一样直接用4MB页目录项，不需要页表。所用内存都从start_mem处开始取，返回新的主内存区起始地址。
+ * 必须在mem_init()以及任何访问16MB以上内存的操作之前调用.
+ */
+long paging_init(long start_mem, long end_mem)
+{
+    unsigned long *pg_table;
+    unsigned long addr;
+    int dir;
+
+    start_mem = PAGE_ALIGN(start_mem);
+
+    /* 16MB以上的内存，每4MB需要一个页表，页表本身放在start_mem(16MB以下)处. */
+    for (addr = 16 * 1024 * 1024, dir = 4; addr < end_mem; dir++)
+    {
+        if (cpu_features & CPU_PSE)
+        {
+            pg_dir[dir] = addr | PAGE_4M | 7;
+
+            if (cpu_features & CPU_PGE)
+                pg_dir[dir] |= PAGE_GLOBAL;
+
+            addr += 0x400000;
+            continue;
+        }
+
+        pg_table = (unsigned long *)start_mem;
+        start_mem += PAGE_SIZE;
+
+        /* 7是标志信息，表示(Usr, R/W, Present)，与head.s中建立的表项相同. */
+        do
+        {
+            *pg_table++ = addr | 7;
+            addr += PAGE_SIZE;
+        } while (addr & 0x3fffff);
+
+        pg_dir[dir] = (start_mem - PAGE_SIZE) | 7;
+    }
+
+    invalidate();
+
+    /* 实际分页内存页数，以及按此大小分配的两个字节图. */
+    paging_pages = (end_mem - LOW_MEM) >> 12;
+    mem_map = (unsigned char *)start_mem;
+    start_mem += paging_pages;
+    page_order = (unsigned char *)start_mem;
+    start_mem += paging_pages;
+
+    return PAGE_ALIGN(start_mem);
+}
+
 /**
  * 物理内存初始化。
  * 参数：
  * start_mem    - 可用作分页处理的物理内存起始位置(已去除RAMDISK所占内存空间等)。
  * end_mem      - 实际物理内存最大地址。
- * 在该版的linux内核中，最多能使用16Mb的内存，大于16Mb的内存将不于考虑，弃置不用，
- * 0-1Mb内存空间用于内核系统(其实是0-640Kb).
+ * map, nr_map  - BIOS E820内存映射表及其项数。nr_map为0表示没有该表，此时认为
+ *                start_mem到end_mem之间全是可用内存.
+ * 最多能使用MAX_MEMORY的内存，0-1Mb内存空间用于内核系统(其实是0-640Kb).
  */
-void mem_init(long start_mem, long end_mem)
+void mem_init(long start_mem, long end_mem, struct e820entry *map, int nr_map)
 {
+    unsigned long start, end;
     int i;
 
     /* 设置内存最高端. */
@@ -728,20 +1518,42 @@ void mem_init(long start_mem, long end_mem)
 
     /* 首先置所有页面为已占用(USED=100)状态,即将页面映射数组全置成 USED. */
     for (i = 0; i < PAGING_PAGES; i++)
+    {
         mem_map[i] = USED;
+        page_order[i] = 0;
+    }
 
-    /* 然后计算可使用起始内存的页面号. */
-    i = MAP_NR(start_mem);
+    /* 没有内存映射表时，把整个主内存区当作一个可用区域. */
+    if (!nr_map)
+    {
+        mem_free_range(start_mem, end_mem);
+        return;
+    }
+
+    /**
+     * 否则只把表中类型为可用内存的区域交给伙伴系统，区域中的空洞(ISA空洞、ACPI数据等)
+     * 保持USED状态。4GB以上的区域内核无法访问，忽略.
+     */
+    for (; nr_map-- > 0; map++)
+    {
+        if (map->type != E820_RAM || map->addr_hi)
+            continue;
 
-    /* 再计算可分页处理的内存块大小. */
-    end_mem -= start_mem;
+        start = map->addr;
+        end = start + map->size;
 
-    /* 从而计算出可用于分页处理的页面数. */
-    end_mem >>= 12;
+        if (map->size_hi || end < start)
+            end = 0xfffff000;
 
-    /* 最后将这些可用页面对应的页面映射数组清零. */
-    while (end_mem-- > 0)
-        mem_map[i++] = 0;
+        if (start < start_mem)
+            start = start_mem;
+
+        if (end > end_mem)
+            end = end_mem;
+
+        if (start < end)
+            mem_free_range(start, end);
+    }
 }
 
 /**
@@ -749,20 +1561,26 @@ void mem_init(long start_mem, long end_mem)
  */
 void calc_mem(void)
 {
-    int i, j, k, free = 0;
+    int i, j, k;
     long *pg_tbl;
+    struct free_block *block;
 
-    /* 扫描内存页面映射数组mem_map[]，获取空闲页面数并显示. */
-    for (i = 0; i < PAGING_PAGES; i++)
-        if (!mem_map[i])
-            free++;
+    /* 统计各阶空闲链表中的块数并显示. */
+    for (i = 0; i < NR_ORDERS; i++)
+    {
+        for (k = 0, block = free_area[i]; block; block = block->next)
+            k++;
+
+        printk("order %d: %d free blocks\n\r", i, k);
+    }
 
-    printk("%d pages free (of %d)\n\r", free, PAGING_PAGES);
+    printk("%d pages free (of %d), %d zeroed in pool\n\r", nr_free_pages, PAGING_PAGES,
+           zero_pool_nr);
 
-    /* 扫描所有页目录项(除0，1项)，如果页目录项有效，则统计对应页表中有效页面数，并显示. */
+    /* 扫描所有页目录项(除0，1项)，如果页目录项有效且不是4MB页，则统计对应页表中有效页面数，并显示. */
     for (i = 2; i < 1024; i++)
     {
-        if (1 & pg_dir[i])
+        if ((1 & pg_dir[i]) && !(PAGE_4M & pg_dir[i]))
         {
             pg_tbl = (long *)(0xfffff000 & pg_dir[i]);
 
@@ -0,0 +1,513 @@
+/*
+ *  linux/mm/mmap.c
+ */
+
+/**
+ * 本程序实现文件的内存映射(mmap()/munmap()系统调用)。每个进程在任务结构中最多有
+ * NR_MMAP个映射区，映射区中的页面在第一次访问时才由缺页异常从文件读入(需求加载)。
+ *
+ * 读入页面之前先在所有进程的映射区中找同一文件同一偏移处已在内存中的页面，找到则
+ * 直接共享，这样多个进程映射同一个大文件时只占一份内存。共享映射(MAP_SHARED)的页面
+ * 是可写的，修改对所有映射者可见，在解除映射或进程退出时写回文件；私有映射
+ * (MAP_PRIVATE)的页面以只读方式映射，写时复制.
+ *
+ * 注意：映射的页面与高速缓冲区中的文件数据是相互独立的，read()/write()看不到共享
+ * 映射中尚未写回的修改.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/system.h>
+#include <asm/segment.h>
+
+/* 每个进程的线性空间大小(64MB). */
+#define TASK_SIZE               0x4000000
+
+volatile void do_exit(long code);
+
+/* 进程逻辑地址addr对应的页表项指针，页表不存在时为NULL. */
+static unsigned long *page_entry(struct task_struct *p, unsigned long addr)
+{
+    unsigned long dir;
+
+    addr += p->start_code;
+    dir = pg_dir[addr >> 22];
+
+    if (!(dir & 1))
+        return NULL;
+
+    return ((addr >> 12) & 0x3ff) + (unsigned long *)(dir & 0xfffff000);
+}
+
+/**
+ * 在当前进程中查找包含逻辑地址addr的映射区，没有则返回NULL.
+ */
+struct vm_area *find_vma(unsigned long addr)
+{
+    struct vm_area *vma;
+
+    for (vma = current->mmap; vma < current->mmap + NR_MMAP; vma++)
+        if (vma->end && addr >= vma->start && addr < vma->end)
+            return vma;
+
+    return NULL;
+}
+
+/**
+ * 把文件inode中从pos开始的一页读到物理页面page处。文件末尾之后的部分清零。
+ * 读盘出错返回0，否则返回1.
+ */
+static int read_mmap_page(struct m_inode *inode, unsigned long pos, unsigned long page)
+{
+    int nr[4], i;
+
+    for (i = 0; i < 4; i++)
+        nr[i] = (pos + i * BLOCK_SIZE < inode->i_size) ?
+                bmap(inode, (pos >> BLOCK_SIZE_BITS) + i) : 0;
+
+    if (!bread_page(page, inode->i_dev, nr))
+        return 0;
+
+    if (pos + PAGE_SIZE > inode->i_size)
+    {
+        i = (pos < inode->i_size) ? inode->i_size - pos : 0;
+        memset((char *)page + i, 0, PAGE_SIZE - i);
+    }
+
+    return 1;
+}
+
+/**
+ * 把共享映射中被修改过的页面page写回文件inode的pos处。只写文件长度以内的部分，
+ * 不会使文件变长.
+ */
+static void write_mmap_page(struct m_inode *inode, unsigned long pos, char *page)
+{
+    struct buffer_head *bh;
+    int block, chars, i;
+
+    invalidate_cache_pages(inode, pos, PAGE_SIZE);
+
+    for (i = 0; i < 4 && pos < inode->i_size; i++, page += BLOCK_SIZE, pos += BLOCK_SIZE)
+    {
+        if (!(block = create_block(inode, pos >> BLOCK_SIZE_BITS)))
+            break;
+
+        if (!(bh = bread(inode->i_dev, block)))
+            break;
+
+        chars = (inode->i_size - pos < BLOCK_SIZE) ? inode->i_size - pos : BLOCK_SIZE;
+        memcpy(bh->b_data, page, chars);
+        bh->b_dirt = 1;
+        brelse(bh);
+    }
+}
+
+/**
+ * 在所有进程的映射区中寻找文件inode中偏移pos处已在内存中的页面。私有映射中的页面
+ * 只有干净的(没被写过，与文件内容相同)才能用，并且要置为只读，以便以后写时复制。
+ * 找到则递增页面的引用计数并返回其物理地址，否则返回0.
+ */
+static unsigned long find_mmap_page(struct m_inode *inode, unsigned long pos)
+{
+    struct task_struct **p;
+    struct vm_area *vma;
+    unsigned long *entry, page;
+
+    for (p = &LAST_TASK; p > &FIRST_TASK; --p)
+    {
+        /* vfork()的子进程用的是父进程的地址空间，不必再查. */
+        if (!*p || (*p)->vfork_parent)
+            continue;
+
+        for (vma = (*p)->mmap; vma < (*p)->mmap + NR_MMAP; vma++)
+        {
+            if (!vma->end || vma->inode != inode)
+                continue;
+
+            if (pos < vma->offset || pos - vma->offset >= vma->end - vma->start)
+                continue;
+
+            if (!(entry = page_entry(*p, vma->start + pos - vma->offset)))
+                continue;
+
+            page = *entry;
+
+            if (!(page & 1) || (page & 0xfffff000) < LOW_MEM)
+                continue;
+
+            if (!(vma->flags & MAP_SHARED))
+            {
+                if (page & PAGE_DIRTY)
+                    continue;
+
+                *entry &= ~PAGE_RW;
+                invalidate_page((*p)->start_code + vma->start + pos - vma->offset);
+            }
+
+            page &= 0xfffff000;
+            mem_map[MAP_NR(page)]++;
+
+            return page;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * 缺页处理：若线性地址address位于当前进程的某个映射区中，则把对应的文件页面映射
+ * 进来(读盘出错时发SIGBUS信号)并返回1，否则返回0(由do_no_page()按普通页面处理).
+ */
+int do_mmap_page(unsigned long address)
+{
+    struct vm_area *vma;
+    unsigned long pos, page, tmp, flags, *entry;
+
+    if (!(vma = find_vma(address - current->start_code)))
+        return 0;
+
+    pos = vma->offset + (address - current->start_code - vma->start);
+
+    if (page = find_mmap_page(vma->inode, pos))
+        count_fault(min_flt);
+    else
+    {
+        if (!(page = get_free_page()))
+            oom();
+
+        count_fault(maj_flt);
+
+        /* 读盘出错则不映射，与换入出错一样发SIGBUS信号. */
+        if (!read_mmap_page(vma->inode, pos, page))
+        {
+            free_page(page);
+            current->signal |= 1 << (SIGBUS - 1);
+            return 1;
+        }
+
+        /* 读文件时会睡眠，期间别的进程可能已读入了同一页，共享映射必须用同一页面. */
+        if (tmp = find_mmap_page(vma->inode, pos))
+        {
+            free_page(page);
+            page = tmp;
+        }
+    }
+
+    /* 私有映射只读映射进来，写时复制；共享映射按保护属性决定是否可写. */
+    flags = PAGE_USER | PAGE_PRESENT;
+
+    if (vma->flags & MAP_SHARED)
+    {
+        flags |= PAGE_SHARED_MMAP;
+
+        if (vma->prot & PROT_WRITE)
+            flags |= PAGE_RW;
+    }
+
+    if (!(entry = get_page_entry(address)))
+    {
+        free_page(page);
+        oom();
+    }
+
+    *entry = page | flags;
+    current->rss++;
+
+    return 1;
+}
+
+/**
+ * 写保护异常处理：若线性地址address位于当前进程的某个映射区中，则处理后返回1，
+ * 否则返回0(由调用者按普通的写时复制处理)。私有可写映射也返回0，按写时复制处理.
+ */
+int mmap_wp_page(unsigned long address, unsigned long *table_entry)
+{
+    struct vm_area *vma;
+
+    if (!(vma = find_vma(address - current->start_code)))
+        return 0;
+
+    if (!(vma->prot & PROT_WRITE))
+        do_exit(SIGSEGV);
+
+    if (!(vma->flags & MAP_SHARED))
+        return 0;
+
+    /* 共享映射的页面是所有映射者共用的(fork()后也一样)，直接置为可写. */
+    *table_entry |= PAGE_RW;
+    invalidate_page(address);
+
+    return 1;
+}
+
+/**
+ * 把进程p的映射区vma中逻辑地址[from, to)内被修改过的页面写回文件.
+ */
+static void sync_vma(struct task_struct *p, struct vm_area *vma,
+                     unsigned long from, unsigned long to)
+{
+    unsigned long *entry;
+
+    if (!(vma->flags & MAP_SHARED))
+        return;
+
+    for (; from < to; from += PAGE_SIZE)
+        if ((entry = page_entry(p, from)) && (*entry & (PAGE_DIRTY | 1)) == (PAGE_DIRTY | 1))
+            write_mmap_page(vma->inode, vma->offset + from - vma->start,
+                            (char *)(*entry & 0xfffff000));
+}
+
+/**
+ * 释放当前进程逻辑地址[from, to)内的页面(或交换页)并清除页表项，不写回文件.
+ */
+static void clear_pages(unsigned long from, unsigned long to)
+{
+    unsigned long *entry, *dir, start = from;
+
+    for (; from < to; from += PAGE_SIZE)
+    {
+        dir = pg_dir + ((from + current->start_code) >> 22);
+
+        if (!(*dir & 1))
+            continue;
+
+        /* 页表可能与fork()出的进程共享，要先取消共享，否则会把对方的映射也清掉. */
+        if (!(*dir & 2))
+            unshare_page_table(dir);
+
+        entry = page_entry(current, from);
+
+        if (*entry & 1)
+        {
+            free_page(*entry & 0xfffff000);
+            current->rss--;
+        }
+        else if (*entry)
+            swap_free(*entry >> 1);
+
+        *entry = 0;
+    }
+
+    invalidate_range(current->start_code + start, current->start_code + to);
+}
+
+/**
+ * 解除当前进程逻辑地址[from, to)内的页面映射：写回修改过的共享页面，释放页面
+ * (或交换页)并清除页表项.
+ */
+static void unmap_pages(struct vm_area *vma, unsigned long from, unsigned long to)
+{
+    sync_vma(current, vma, from, to);
+    clear_pages(from, to);
+}
+
+/**
+ * 解除当前进程逻辑地址[addr, addr+len)内的映射。映射区被部分解除时会被截短，
+ * 从中间解除时分裂为两个映射区.
+ */
+static int do_munmap(unsigned long addr, unsigned long len)
+{
+    struct vm_area *vma, *new_vma = NULL;
+    unsigned long end;
+
+    if ((addr & 0xfff) || !len)
+        return -EINVAL;
+
+    end = PAGE_ALIGN(addr + len);
+
+    if (end > TASK_SIZE || end < addr)
+        return -EINVAL;
+
+    /* 先确认需要分裂时有空闲的映射区项，以免解除了一半才出错. */
+    for (vma = current->mmap; vma < current->mmap + NR_MMAP; vma++)
+        if (vma->end && addr > vma->start && end < vma->end)
+        {
+            for (new_vma = current->mmap; new_vma < current->mmap + NR_MMAP; new_vma++)
+                if (!new_vma->end)
+                    break;
+
+            if (new_vma >= current->mmap + NR_MMAP)
+                return -ENOMEM;
+        }
+
+    for (vma = current->mmap; vma < current->mmap + NR_MMAP; vma++)
+    {
+        if (!vma->end || end <= vma->start || addr >= vma->end)
+            continue;
+
+        unmap_pages(vma, (addr > vma->start) ? addr : vma->start,
+                    (end < vma->end) ? end : vma->end);
+
+        if (addr <= vma->start && end >= vma->end)
+        {
+            iput(vma->inode);
+            vma->inode = NULL;
+            vma->start = vma->end = 0;
+        }
+        else if (addr <= vma->start)
+        {
+            vma->offset += end - vma->start;
+            vma->start = end;
+        }
+        else if (end >= vma->end)
+            vma->end = addr;
+        else
+        {
+            *new_vma = *vma;
+            new_vma->offset += end - vma->start;
+            new_vma->start = end;
+            new_vma->inode->i_count++;
+            vma->end = addr;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * 在映射区空间[MMAP_START, MMAP_END)中找一段长为len的空闲地址，没有则返回0。
+ * 堆(brk)长过MMAP_START时从堆顶之上开始找，以免映射区盖住数据段.
+ */
+static unsigned long get_unmapped_area(unsigned long len)
+{
+    struct vm_area *vma;
+    unsigned long addr = PAGE_ALIGN(current->brk);
+
+    if (addr < MMAP_START)
+        addr = MMAP_START;
+
+repeat:
+    if (addr + len > MMAP_END)
+        return 0;
+
+    for (vma = current->mmap; vma < current->mmap + NR_MMAP; vma++)
+        if (vma->end && addr < vma->end && addr + len > vma->start)
+        {
+            addr = vma->end;
+            goto repeat;
+        }
+
+    return addr;
+}
+
+/**
+ * 系统调用：把文件映射到内存。参数在用户空间的mmap_arg_struct结构中(见sys/mman.h)。
+ * 只能映射普通文件，文件偏移必须按页对齐。成功返回映射区的起始地址.
+ */
+int sys_mmap(struct mmap_arg_struct *arg)
+{
+    struct vm_area *vma;
+    struct file *file;
+    struct m_inode *inode;
+    unsigned long addr, len, offset;
+    int prot, flags, fd, mode, err;
+
+    addr = get_fs_long(&arg->addr);
+    len = PAGE_ALIGN(get_fs_long(&arg->len));
+    prot = get_fs_long((unsigned long *)&arg->prot);
+    flags = get_fs_long((unsigned long *)&arg->flags);
+    fd = get_fs_long((unsigned long *)&arg->fd);
+    offset = get_fs_long((unsigned long *)&arg->offset);
+
+    if (!len || len > TASK_SIZE || (offset & 0xfff))
+        return -EINVAL;
+
+    if ((flags & MAP_TYPE) != MAP_SHARED && (flags & MAP_TYPE) != MAP_PRIVATE)
+        return -EINVAL;
+
+    if (fd >= NR_OPEN || fd < 0 || !(file = current->filp[fd]))
+        return -EBADF;
+
+    inode = file->f_inode;
+
+    if (!inode || !S_ISREG(inode->i_mode))
+        return -ENODEV;
+
+    /* 文件必须可读；可写的共享映射还要求文件以读写方式打开. */
+    mode = file->f_flags & O_ACCMODE;
+
+    if (mode == O_WRONLY)
+        return -EACCES;
+
+    if ((flags & MAP_TYPE) == MAP_SHARED && (prot & PROT_WRITE) && mode != O_RDWR)
+        return -EACCES;
+
+    /**
+     * 固定地址的映射不能与数据段和堆栈重叠(与sys_brk()一样在堆栈下留16KB)，原有的
+     * 映射则被替换。do_munmap()拆分映射区时要占用一个空闲项，所以必须先解除原有
+     * 映射，再找空闲项.
+     */
+    if (flags & MAP_FIXED)
+    {
+        if ((addr & 0xfff) || addr < PAGE_ALIGN(current->brk) ||
+            addr + len > ((current->start_stack - 16384) & 0xfffff000) || addr + len < addr)
+            return -EINVAL;
+
+        if ((err = do_munmap(addr, len)))
+            return err;
+    }
+    else if (!(addr = get_unmapped_area(len)))
+        return -ENOMEM;
+
+    for (vma = current->mmap; vma < current->mmap + NR_MMAP; vma++)
+        if (!vma->end)
+            break;
+
+    if (vma >= current->mmap + NR_MMAP)
+        return -ENOMEM;
+
+    /**
+     * 映射区之外的页面(缩小堆后留下的页面等)不属于文件，映射前要释放掉，否则缺页时
+     * 不会读文件，共享映射还会把它们写到文件里.
+     */
+    clear_pages(addr, addr + len);
+
+    vma->start = addr;
+    vma->end = addr + len;
+    vma->offset = offset;
+    vma->inode = inode;
+    vma->prot = prot;
+    vma->flags = flags & MAP_TYPE;
+    inode->i_count++;
+
+    return addr;
+}
+
+/**
+ * 系统调用：解除[addr, addr+len)内的映射.
+ */
+int sys_munmap(unsigned long addr, unsigned long len)
+{
+    return do_munmap(addr, len);
+}
+
+/**
+ * 进程退出或执行execve()时调用，释放进程p的所有映射区。修改过的共享页面写回文件，
+ * 页面本身随后由free_page_tables()释放。vfork()的子进程用的是父进程的地址空间，
+ * 只释放对文件的引用.
+ */
+void exit_mmap(struct task_struct *p)
+{
+    struct vm_area *vma;
+
+    for (vma = p->mmap; vma < p->mmap + NR_MMAP; vma++)
+    {
+        if (!vma->end)
+            continue;
+
+        if (!p->vfork_parent)
+            sync_vma(p, vma, vma->start, vma->end);
+
+        iput(vma->inode);
+        vma->inode = NULL;
+        vma->start = vma->end = 0;
+    }
+}
@@ -0,0 +1,274 @@
+/*
+ *  linux/mm/page_cache.c
+ */
+
+/**
+ * 执行文件页面缓存。缺页时从执行文件读入的页面按(设备号, i节点号, 偏移)登记在这里，
+ * 缓存本身持有页面的一个引用，所以运行同一程序的进程可以在常数时间内找到并共享页面，
+ * 而且最后一个使用它的进程退出后页面仍然保留，下次执行时不必再读盘.
+ *
+ * 偏移是页面在执行映像中的偏移(即文件偏移减去1块的执行文件头)，与do_no_page()中
+ * 的计算相同。缓存中的页面都是干净的，被映射为只读，进程写时复制。文件被写或被截断
+ * 时相应的页面要作废.
+ *
+ * 所有缓存页面按最近使用的先后链成LRU循环链表(与高速缓冲的free_list相同的做法)，
+ * 每次命中都移到表尾。缓存满、单个文件的页面数超过上限或者内存不够时，从表头开始
+ * 回收最久未用且没有进程在用(只被缓存引用)的页面。这样经常执行的程序的代码页面
+ * 会一直留在内存中，一个很大的程序也不会把别的程序的页面都挤出去.
+ */
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+
+/* 缓存的最大页面数、每个执行文件最多的页面数以及散列表项数. */
+#define NR_CACHE_PAGES          512
+#define MAX_INODE_PAGES         128
+#define NR_CACHE_HASH           128
+
+struct cache_page
+{
+    unsigned short dev;             /* 执行文件所在设备. */
+    unsigned short ino;             /* 执行文件的i节点号. */
+    unsigned long offset;           /* 页面在执行映像中的偏移. */
+    unsigned long page;             /* 页面物理地址，0表示空闲项. */
+    struct cache_page *next;        /* 散列链表，空闲项也用它链接. */
+    struct cache_page *lru_prev;    /* LRU循环链表. */
+    struct cache_page *lru_next;
+};
+
+static struct cache_page cache_table[NR_CACHE_PAGES];
+static struct cache_page *hash_table[NR_CACHE_HASH];
+static struct cache_page *free_cache = NULL;
+/* LRU链表头，指向最久未用的页面. */
+static struct cache_page *lru_list = NULL;
+static int cache_inited = 0;
+
+#define _hashfn(dev, ino, offset)   (((unsigned)((dev) ^ (ino) ^ ((offset) >> 12))) % NR_CACHE_HASH)
+#define hash(dev, ino, offset)      hash_table[_hashfn(dev, ino, offset)]
+
+/* 第一次使用时把所有表项链入空闲链表. */
+static void init_cache(void)
+{
+    int i;
+
+    for (i = 0; i < NR_CACHE_PAGES; i++)
+    {
+        cache_table[i].next = free_cache;
+        free_cache = cache_table + i;
+    }
+
+    cache_inited = 1;
+}
+
+/* 从LRU链表中取下表项cp. */
+static void lru_remove(struct cache_page *cp)
+{
+    if (cp->lru_next == cp)
+    {
+        lru_list = NULL;
+        return;
+    }
+
+    cp->lru_prev->lru_next = cp->lru_next;
+    cp->lru_next->lru_prev = cp->lru_prev;
+
+    if (lru_list == cp)
+        lru_list = cp->lru_next;
+}
+
+/* 把表项cp放到LRU链表尾(最近使用端). */
+static void lru_add(struct cache_page *cp)
+{
+    if (!lru_list)
+    {
+        lru_list = cp->lru_prev = cp->lru_next = cp;
+        return;
+    }
+
+    cp->lru_next = lru_list;
+    cp->lru_prev = lru_list->lru_prev;
+    lru_list->lru_prev->lru_next = cp;
+    lru_list->lru_prev = cp;
+}
+
+static struct cache_page *find_entry(int dev, int ino, unsigned long offset)
+{
+    struct cache_page *cp;
+
+    for (cp = hash(dev, ino, offset); cp; cp = cp->next)
+        if (cp->dev == dev && cp->ino == ino && cp->offset == offset)
+            return cp;
+
+    return NULL;
+}
+
+/* 从散列链表中删除表项cp，释放缓存对页面的引用，并把表项放回空闲链表. */
+static void remove_entry(struct cache_page *cp)
+{
+    struct cache_page **pp;
+
+    for (pp = &hash(cp->dev, cp->ino, cp->offset); *pp; pp = &(*pp)->next)
+        if (*pp == cp)
+        {
+            *pp = cp->next;
+            break;
+        }
+
+    lru_remove(cp);
+    free_page(cp->page);
+    cp->page = 0;
+    cp->next = free_cache;
+    free_cache = cp;
+}
+
+/**
+ * 查找执行文件inode中偏移offset处的页面。找到则递增其引用计数并返回物理地址，
+ * 调用者应把它映射为只读；否则返回0.
+ */
+unsigned long find_cache_page(struct m_inode *inode, unsigned long offset)
+{
+    struct cache_page *cp;
+
+    if (!(cp = find_entry(inode->i_dev, inode->i_num, offset)))
+        return 0;
+
+    lru_remove(cp);
+    lru_add(cp);
+    mem_map[MAP_NR(cp->page)]++;
+
+    return cp->page;
+}
+
+/**
+ * 从LRU链表头开始找最久未用、没有进程在用的页面。inode不为NULL时只找该文件的页面，
+ * 并把该文件缓存的页面数存入*count.
+ */
+static struct cache_page *lru_victim(struct m_inode *inode, int *count)
+{
+    struct cache_page *cp, *victim = NULL;
+
+    if (count)
+        *count = 0;
+
+    if (!(cp = lru_list))
+        return NULL;
+
+    do
+    {
+        if (inode && (cp->dev != inode->i_dev || cp->ino != inode->i_num))
+            continue;
+
+        if (count)
+            (*count)++;
+
+        if (!victim && mem_map[MAP_NR(cp->page)] == 1)
+        {
+            victim = cp;
+
+            if (!count)
+                break;
+        }
+    } while ((cp = cp->lru_next) != lru_list);
+
+    return victim;
+}
+
+/**
+ * 把刚从执行文件inode中偏移offset处读入的干净页面page加入缓存(缓存持有一个引用)。
+ * 该文件的页面已达上限或缓存已满时，顶替最久未用的一个没有进程在用的页面(先在该文件
+ * 自己的页面中找)，都在用则不加入。加入成功返回1，此时调用者必须把页面映射为只读.
+ */
+int add_cache_page(struct m_inode *inode, unsigned long offset, unsigned long page)
+{
+    struct cache_page *cp;
+    int count;
+
+    if (!cache_inited)
+        init_cache();
+
+    /* 读盘时可能已有别的进程加入了同一页. */
+    if (find_entry(inode->i_dev, inode->i_num, offset))
+        return 0;
+
+    cp = lru_victim(inode, &count);
+
+    if (count >= MAX_INODE_PAGES)
+    {
+        if (!cp)
+            return 0;
+
+        remove_entry(cp);
+    }
+
+    if (!free_cache)
+    {
+        if (!(cp = lru_victim(NULL, NULL)))
+            return 0;
+
+        remove_entry(cp);
+    }
+
+    cp = free_cache;
+    free_cache = cp->next;
+    cp->dev = inode->i_dev;
+    cp->ino = inode->i_num;
+    cp->offset = offset;
+    cp->page = page;
+    cp->next = hash(cp->dev, cp->ino, offset);
+    hash(cp->dev, cp->ino, offset) = cp;
+    lru_add(cp);
+    mem_map[MAP_NR(page)]++;
+
+    return 1;
+}
+
+/**
+ * 文件inode从文件偏移pos开始的count字节被修改，作废缓存中相应的页面。修改涉及执行
+ * 文件头(第1块)时，代码和数据的长度可能都变了，所以作废该文件的所有页面。count为0
+ * 表示直到文件末尾(截断文件时).
+ */
+void invalidate_cache_pages(struct m_inode *inode, unsigned long pos, unsigned long count)
+{
+    struct cache_page *cp;
+    unsigned long offset, end;
+    int i;
+
+    if (!cache_inited)
+        return;
+
+    if (pos < BLOCK_SIZE || !count)
+    {
+        for (i = 0; i < NR_CACHE_PAGES; i++)
+        {
+            cp = cache_table + i;
+
+            if (cp->page && cp->dev == inode->i_dev && cp->ino == inode->i_num &&
+                (pos < BLOCK_SIZE || cp->offset + PAGE_SIZE + BLOCK_SIZE > pos))
+                remove_entry(cp);
+        }
+
+        return;
+    }
+
+    offset = (pos - BLOCK_SIZE) & 0xfffff000;
+    end = pos + count - BLOCK_SIZE;
+
+    for (; offset < end; offset += PAGE_SIZE)
+        if (cp = find_entry(inode->i_dev, inode->i_num, offset))
+            remove_entry(cp);
+}
+
+/**
+ * 内存不够时调用：释放最久未用的一个只被缓存引用的页面。释放了返回1.
+ */
+int shrink_page_cache(void)
+{
+    struct cache_page *cp;
+
+    if (!(cp = lru_victim(NULL, NULL)))
+        return 0;
+
+    remove_entry(cp);
+
+    return 1;
+}
@@ -0,0 +1,440 @@
+/*
+ *  linux/mm/swap.c
+ */
+
+/**
+ * 本程序实现页面交换：在get_free_page()找不到空闲页面时，把某个进程不常用的页面
+ * 写到交换设备上，从而腾出物理内存。交换设备可以是一个硬盘分区，也可以是一个普通
+ * 文件，由swapon()系统调用指定.
+ *
+ * 交换空间的第1页(交换页号0)是位图，每一位对应交换空间中的一页，1表示该页空闲。
+ * 位图页的最后10个字节必须是"SWAP-SPACE"标记。被换出页面的页表项中存放的是
+ * 交换页号左移1位的值(存在位P=0).
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <sys/stat.h>
+
+#include <linux/sched.h>
+#include <linux/head.h>
+#include <linux/kernel.h>
+#include <asm/system.h>
+#include <asm/segment.h>
+
+/* 位图中最多能表示的交换页数(1页位图共4096*8位). */
+#define SWAP_BITS               (4096 << 3)
+
+/* 位操作宏：测试、置位和复位位图addr中的第nr位，都返回该位原来的值. */
+#define bitop(name, op)                                                   \
+    static inline int name(char *addr, unsigned int nr)                  \
+    {                                                                     \
+        int __res;                                                        \
+        __asm__ __volatile__("bt" op " %1,%2; adcl $0,%0"                 \
+                             : "=g"(__res)                                \
+                             : "r"(nr), "m"(*(addr)), "0"(0));            \
+        return __res;                                                     \
+    }
+
+bitop(bit, "")
+bitop(setbit, "s")
+bitop(clrbit, "r")
+
+/* 交换页面位图. */
+static char *swap_bitmap = NULL;
+/* 交换空间的页数(包括位图页). */
+static int swap_pages = 0;
+/* 交换设备号。若交换空间是普通文件，则为该文件所在的设备. */
+int SWAP_DEV = 0;
+/* 作为交换空间的文件的i节点，交换空间是分区时为NULL. */
+static struct m_inode *swap_file = NULL;
+
+/**
+ * 进程线性空间中可以换出的页面从任务1开始(任务0的64MB空间中是内核的恒等映射)，
+ * 直到4GB线性空间的末端.
+ */
+#define FIRST_VM_PAGE           (0x4000000 >> 12)
+#define LAST_VM_PAGE            (1024 * 1024)
+#define VM_PAGES                (LAST_VM_PAGE - FIRST_VM_PAGE)
+
+/**
+ * 取交换文件中第swap_nr页所对应的4个逻辑块号。若文件中有空洞则返回0(sys_swapon()
+ * 已检查过，不会有空洞).
+ */
+static int swap_file_blocks(int swap_nr, int nr[4])
+{
+    int i, block = swap_nr << 2;
+
+    for (i = 0; i < 4; i++)
+        if (!(nr[i] = bmap(swap_file, block + i)))
+            return 0;
+
+    return 1;
+}
+
+/**
+ * 把交换空间中第swap_nr页读到buffer处。读盘出错返回0，否则返回1.
+ */
+int read_swap_page(int swap_nr, char *buffer)
+{
+    int nr[4];
+
+    if (!swap_file)
+        return ll_rw_page(READ, SWAP_DEV, swap_nr, buffer);
+
+    if (!swap_file_blocks(swap_nr, nr))
+    {
+        printk("read_swap_page: hole in swap file\n\r");
+        return 0;
+    }
+
+    return bread_page((unsigned long)buffer, SWAP_DEV, nr);
+}
+
+/**
+ * 把buffer处的一页写到交换空间中第swap_nr页。对交换文件是经过高速缓冲直接写盘的.
+ */
+static void write_swap_page(int swap_nr, char *buffer)
+{
+    struct buffer_head *bh;
+    int nr[4], i;
+
+    if (!swap_file)
+    {
+        ll_rw_page(WRITE, SWAP_DEV, swap_nr, buffer);
+        return;
+    }
+
+    if (!swap_file_blocks(swap_nr, nr))
+    {
+        printk("write_swap_page: hole in swap file\n\r");
+        return;
+    }
+
+    for (i = 0; i < 4; i++, buffer += BLOCK_SIZE)
+    {
+        if (!(bh = getblk(SWAP_DEV, nr[i])))
+            panic("write_swap_page: getblk returned NULL");
+
+        memcpy(bh->b_data, buffer, BLOCK_SIZE);
+        bh->b_uptodate = 1;
+        bh->b_dirt = 1;
+        ll_rw_block(WRITE, bh);
+        brelse(bh);
+    }
+}
+
+/**
+ * 在位图中找一个空闲的交换页，返回其交换页号，若没有则返回0.
+ */
+static int get_swap_page(void)
+{
+    int nr;
+
+    if (!swap_bitmap)
+        return 0;
+
+    for (nr = 1; nr < swap_pages; nr++)
+        if (clrbit(swap_bitmap, nr))
+            return nr;
+
+    return 0;
+}
+
+/**
+ * 释放交换页swap_nr。在释放含有已换出页面的页表时调用.
+ */
+void swap_free(int swap_nr)
+{
+    if (!swap_nr)
+        return;
+
+    if (swap_bitmap && swap_nr < swap_pages)
+        if (!setbit(swap_bitmap, swap_nr))
+            return;
+
+    printk("Swap-space bad (swap_free())\n\r");
+}
+
+/**
+ * 把页表项table_ptr所指的已换出页面读回内存。读盘出错时不装入页面(页表项仍指向
+ * 交换页)，给当前进程发SIGBUS信号。页面装入了返回1，否则返回0.
+ */
+int swap_in(unsigned long *table_ptr)
+{
+    int swap_nr;
+    unsigned long page;
+
+    if (!swap_bitmap)
+    {
+        printk("Trying to swap in without swap bit-map");
+        return 0;
+    }
+
+    if (1 & *table_ptr)
+    {
+        printk("trying to swap in present page\n\r");
+        return 0;
+    }
+
+    swap_nr = *table_ptr >> 1;
+
+    if (!swap_nr)
+    {
+        printk("No swap page in swap_in\n\r");
+        return 0;
+    }
+
+    if (!(page = get_free_page()))
+        oom();
+
+    if (!read_swap_page(swap_nr, (char *)page))
+    {
+        printk("I/O error swapping in page %d\n\r", swap_nr);
+        free_page(page);
+        current->signal |= 1 << (SIGBUS - 1);
+        return 0;
+    }
+
+    if (setbit(swap_bitmap, swap_nr))
+        printk("swapping in multiply from same page\n\r");
+
+    /* 页面内容与交换空间中已不再一致(交换页已释放)，所以要置为脏页. */
+    *table_ptr = page | (PAGE_DIRTY | 7);
+
+    return 1;
+}
+
+/**
+ * 尝试换出页表项table_ptr所指的页面。这是一个时钟(clock)算法：最近被访问过的页面
+ * (访问位A=1)不换出，只清除其访问位，给它第二次机会。
+ * 干净的页面可以从执行文件(或页面缓存)重新得到或重新清零，所以直接撤销映射，即使
+ * 页面还被别的进程或页面缓存引用也可以，等引用都没有了页面就被释放(页面缓存中的
+ * 页面由shrink_page_cache()释放)。只有不被共享的脏页面才能写入交换空间。
+ * address是页面的线性地址，用于刷新其TLB项。确实释放了一个页面才返回1，只撤销了
+ * 映射而页面还有别的引用时返回0，让swap_out()继续找.
+ */
+static int try_to_swap_out(unsigned long *table_ptr, unsigned long address)
+{
+    unsigned long page;
+    int swap_nr;
+
+    page = *table_ptr;
+
+    if (!(PAGE_PRESENT & page))
+        return 0;
+
+    if ((page & 0xfffff000) < LOW_MEM || (page & 0xfffff000) >= HIGH_MEMORY)
+        return 0;
+
+    if (PAGE_ACCESSED & page)
+    {
+        *table_ptr &= ~PAGE_ACCESSED;
+        return 0;
+    }
+
+    if (PAGE_DIRTY & page)
+    {
+        if (mem_map[MAP_NR(page & 0xfffff000)] != 1)
+            return 0;
+
+        /* 修改过的共享映射页面要写回文件(解除映射时)，不能放到交换空间去. */
+        if (PAGE_SHARED_MMAP & page)
+            return 0;
+
+        if (!(swap_nr = get_swap_page()))
+            return 0;
+
+        *table_ptr = swap_nr << 1;
+        invalidate_page(address);
+        rss_add(address, -1);
+        write_swap_page(swap_nr, (char *)(page & 0xfffff000));
+        free_page(page & 0xfffff000);
+        return 1;
+    }
+
+    *table_ptr = 0;
+    invalidate_page(address);
+    rss_add(address, -1);
+    free_page(page & 0xfffff000);
+
+    return !mem_map[MAP_NR(page & 0xfffff000)];
+}
+
+/**
+ * 页表可以扫描：存在，且不与其它进程共享(见copy_page_tables())。共享页表中的页面
+ * 还能通过别的目录项访问，只刷新一个线性地址的TLB项不够，所以这种页表不扫描，等
+ * 写时复制取消共享后再说.
+ */
+#define table_swappable(pg_table) \
+    (((pg_table) & 1) && ((pg_table) & 0xfffff000) >= LOW_MEM && \
+     mem_map[MAP_NR((pg_table) & 0xfffff000)] == 1)
+
+/**
+ * 换出一个页面。按线性地址顺序依次扫描各进程的页表，扫描位置保存在静态变量中，
+ * 下一次从上次停下的地方继续(时钟指针)。每个页面最多被扫描两次：第一次清除访问位，
+ * 第二次才可能被换出。成功换出一页返回1，否则返回0.
+ */
+int swap_out(void)
+{
+    static int dir_entry = FIRST_VM_PAGE >> 10;
+    static int page_entry = -1;
+    int counter = VM_PAGES * 2;
+    unsigned long pg_table = 0;
+
+    if (dir_entry < (FIRST_VM_PAGE >> 10) || dir_entry >= 1024)
+        dir_entry = FIRST_VM_PAGE >> 10;
+
+    if (page_entry >= 0)
+        pg_table = pg_dir[dir_entry];
+
+    while (counter-- > 0)
+    {
+        page_entry++;
+
+        /* 当前页表扫描完(或页表不能扫描)，则移到下一个可扫描的页表. */
+        if (page_entry >= 1024 || !table_swappable(pg_table))
+        {
+            page_entry = 0;
+
+            do
+            {
+                if (++dir_entry >= 1024)
+                    dir_entry = FIRST_VM_PAGE >> 10;
+
+                pg_table = pg_dir[dir_entry];
+
+                if (table_swappable(pg_table))
+                    break;
+
+                counter -= 1024;
+            } while (counter > 0);
+
+            if (!table_swappable(pg_table))
+                break;
+        }
+
+        if (try_to_swap_out(page_entry + (unsigned long *)(pg_table & 0xfffff000),
+                            (dir_entry << 22) + (page_entry << 12)))
+            return 1;
+    }
+
+    if (swap_bitmap)
+        printk("Out of swap-memory\n\r");
+
+    return 0;
+}
+
+/**
+ * 系统调用：启用交换空间。参数specialfile是硬盘分区(或虚拟盘)设备文件名，或者
+ * 一个已建好(没有空洞)的普通文件名。只有超级用户才能使用，且只支持一个交换空间.
+ */
+int sys_swapon(const char *specialfile)
+{
+    struct m_inode *inode;
+    unsigned long page;
+    int dev, i, j, nr[4];
+
+    if (!suser())
+        return -EPERM;
+
+    if (swap_bitmap)
+        return -EBUSY;
+
+    if (!(inode = namei(specialfile)))
+        return -ENOENT;
+
+    if (S_ISBLK(inode->i_mode))
+    {
+        dev = inode->i_zone[0];
+
+        /* 只有硬盘和虚拟盘能处理整页的请求. */
+        if (MAJOR(dev) != 3 && MAJOR(dev) != 1)
+        {
+            iput(inode);
+            return -ENODEV;
+        }
+
+        iput(inode);
+        inode = NULL;
+    }
+    else if (S_ISREG(inode->i_mode))
+        dev = inode->i_dev;
+    else
+    {
+        iput(inode);
+        return -EINVAL;
+    }
+
+    if (!(page = get_free_page()))
+    {
+        iput(inode);
+        return -ENOMEM;
+    }
+
+    /* 读入交换空间的第1页(位图页)，并检查其末尾的标记. */
+    SWAP_DEV = dev;
+    swap_file = inode;
+
+    if (inode && !swap_file_blocks(0, nr))
+    {
+        printk("Swap file has holes\n\r");
+        goto bad;
+    }
+
+    if (!read_swap_page(0, (char *)page))
+    {
+        printk("Unable to read swap-space bit-map\n\r");
+        goto bad;
+    }
+
+    if (strncmp("SWAP-SPACE", (char *)page + 4086, 10))
+    {
+        printk("Unable to find swap-space signature\n\r");
+        goto bad;
+    }
+
+    memset((char *)page + 4086, 0, 10);
+
+    /* 交换页0(位图页本身)不能被使用，有效的交换页之后的位也必须都是0. */
+    if (bit((char *)page, 0))
+        goto bad;
+
+    for (i = j = 0; i < SWAP_BITS; i++)
+        if (bit((char *)page, i))
+            j = i + 1;
+
+    if (!j || (inode && (j << 12) > inode->i_size))
+    {
+        printk("Bad swap-space bit-map\n\r");
+        goto bad;
+    }
+
+    /* 交换文件不能有空洞：每一页的4个块都必须已经分配. */
+    for (i = 1; inode && i < j; i++)
+        if (!swap_file_blocks(i, nr))
+        {
+            printk("Swap file has holes\n\r");
+            goto bad;
+        }
+
+    swap_pages = j;
+
+    for (i = j = 0; i < swap_pages; i++)
+        if (bit((char *)page, i))
+            j++;
+
+    swap_bitmap = (char *)page;
+    printk("Swap device ok: %d pages (%d bytes) swap-space\n\r", j, j * 4096);
+
+    return 0;
+
+bad:
+    free_page(page);
+    SWAP_DEV = 0;
+    swap_file = NULL;
+    iput(inode);
+
+    return -EINVAL;
+}